@@ -1,18 +1,16 @@
+// Программа archiver: разбор командной строки поверх библиотеки simplearchiver
+
 #include <stdio.h>       // Стандартная библиотека ввода-вывода
 #include <stdlib.h>      // Стандартная библиотека общих функций
 #include <string.h>      // Библиотека для работы со строками
-#include <dirent.h>      // Библиотека для работы с каталогами
-#include <sys/stat.h>    // Библиотека для работы с информацией о файлах и каталогах
 #include <unistd.h>      // Библиотека для доступа к POSIX API
 #include <stdint.h>      // Библиотека для определения целочисленных типов с фиксированной шириной
 #include <errno.h>       // Библиотека для обработки ошибок
 #include <limits.h>      // Библиотека для определения пределов целочисленных типов
 #include <pwd.h>         // Библиотека для получения информации о пользователе (Linux)
-#include <libgen.h>      // Библиотека для функций dirname() и basename()
 
-#define BUFFER_SIZE 1024        // Размер буфера для чтения и записи данных
-#define FILE_ENTRY 0x01         // Константа, обозначающая файл в архиве
-#define DIRECTORY_ENTRY 0x02    // Константа, обозначающая директорию в архиве
+#include "simplearchiver.h" // Библиотека архиватора
+
 #define ARCHIVE_EXTENSION ".sa" // Расширение файлов архива
 
 // Прототипы функций
@@ -20,14 +18,11 @@ const char *get_home_directory();                          // Получение
 int has_correct_extension(const char *filename, const char *extension); // Проверка расширения файла
 void add_extension_if_missing(char *filename, const char *extension);   // Добавление расширения, если отсутствует
 void print_usage(const char *program_name);                // Вывод инструкции по использованию программы
-int create_directory(const char *path);                    // Создание директории, если она не существует
-void rle_encode_file(FILE *in, FILE *out);                 // Кодирование файла с помощью RLE
-void rle_decode_file(FILE *in, FILE *out);                 // Декодирование файла с помощью RLE
-void write_entry(FILE *archive, const char *base_path, const char *relative_path); // Запись одной записи в архив
-void pack_directory(FILE *archive, const char *base_path, const char *relative_path); // Рекурсивная упаковка директории
-void pack(const char *input_path, char *archive_path);     // Архивирование файлов и директорий
-void unpack(const char *archive_path, const char *output_folder);       // Разархивация архива
-int main(int argc, char *argv[]);                          // Основная функция программы
+int parse_options(int *argc, char *argv[]);                // Разбор общих параметров командной строки
+int check_archive_extension(const char *archive_path);     // Проверка расширения читаемого архива
+int make_archive_path(char *archive_path, const char *name); // Путь создаваемого архива с расширением
+
+static sa_options_t options; // Параметры операций, заданные в командной строке
 
 // Функция для получения пути к домашней директории пользователя
 const char *get_home_directory() {
@@ -54,278 +49,99 @@ void add_extension_if_missing(char *filename, const char *extension) {
 
 // Функция для вывода инструкции по использованию программы
 void print_usage(const char *program_name) {
-    printf("Использование: %s <опция> <вход> [выход]\n", program_name);
+    printf("Использование: %s <опция> [параметры] <вход> [выход]\n", program_name);
     printf("Опции:\n");
     printf("  -pack <файл_или_папка> <архив>         Упаковать файл или папку в архив (.sa расширение требуется)\n");
     printf("  -unpack <архив> <папка>                Распаковать архив в папку\n");
+    printf("  -list <архив>                          Показать содержимое архива\n");
+    printf("  -extract <архив> <путь> [папка]        Извлечь файл или папку из архива (по умолчанию в текущую папку)\n");
     printf("  -pauto <файл_или_папка> [имя_архива]   Автоматически упаковать в указанный архив в папке Downloads (по умолчанию 'default_archive.sa')\n");
     printf("  -unauto <архив> [имя_папки]            Автоматически распаковать в указанную папку в папке Downloads (по умолчанию 'unpacked_folder')\n");
+    printf("  -update <старый> <файл_или_папка> <новый> Упаковать заново, перенеся неизменившиеся файлы из старого архива без перекодирования\n");
+    printf("                                         (сплошной блок — целиком, если не изменился ни один его файл; копии — ссылками)\n");
+    printf("Параметры:\n");
+    printf("  -j <N>                                 Число потоков упаковки и распаковки (по умолчанию — число процессоров)\n");
+    printf("  -inode                                 Читать файлы каждой папки в порядке inode (быстрее на HDD)\n");
+    printf("  -b <размер>                            Размер буферов ввода-вывода, например 256K или 4M (по умолчанию 1M)\n");
+    printf("  -hash                                  Сохранять хеш содержимого файлов; в -update сравнивать файлы по хешу\n");
+    printf("  -nodedup                               Не искать одинаковые файлы при упаковке\n");
+    printf("  -solid                                 Упаковывать мелкие файлы сплошными блоками (быстрее на множестве мелких файлов)\n");
+    printf("  -hardlink                              Восстанавливать одинаковые файлы жесткими ссылками, а не копиями\n");
 }
 
-// Функция для создания директории, если она не существует
-int create_directory(const char *path) {
-    // Пытаемся создать директорию с правами доступа 0755
-    if (mkdir(path, 0755) == 0 || (errno == EEXIST && access(path, F_OK) == 0)) {
-        return 0; // Директория успешно создана или уже существует
-    }
-    perror("mkdir"); // Выводим сообщение об ошибке, если не удалось создать директорию
-    return -1; // Возвращаем код ошибки
-}
-
-// Функция для кодирования файла с использованием алгоритма Run-Length Encoding (RLE)
-void rle_encode_file(FILE *in, FILE *out) {
-    int prev = fgetc(in); // Читаем первый символ из входного файла
-    if (prev == EOF) return; // Если файл пустой, выходим из функции
-
-    int count = 1; // Счетчик повторений символа
-    int curr;
-
-    // Читаем файл посимвольно и считаем количество повторений каждого символа
-    while ((curr = fgetc(in)) != EOF) {
-        if (curr == prev && count < 255) {
-            count++; // Увеличиваем счетчик, если символ повторяется и счетчик меньше 255
-        } else {
-            fputc(count, out); // Записываем количество повторений
-            fputc(prev, out);  // Записываем сам символ
-            prev = curr;       // Переходим к следующему символу
-            count = 1;         // Сбрасываем счетчик повторений
-        }
-    }
-    // Записываем последние символы
-    fputc(count, out);
-    fputc(prev, out);
-}
-
-// Функция для декодирования файла, закодированного с помощью RLE
-void rle_decode_file(FILE *in, FILE *out) {
-    int count, byte;
-
-    // Читаем данные из входного файла и восстанавливаем оригинальный файл
-    while ((count = fgetc(in)) != EOF) {
-        if ((byte = fgetc(in)) == EOF) break; // Если достигнут конец файла, выходим из цикла
-        for (int i = 0; i < count; i++) {
-            fputc(byte, out); // Записываем символ указанное количество раз
-        }
-    }
-}
-
-// Функция для записи одной записи (файла или директории) в архив
-void write_entry(FILE *archive, const char *base_path, const char *relative_path) {
-    char full_path[PATH_MAX];
-    // Формируем полный путь к файлу или директории
-    snprintf(full_path, sizeof(full_path), "%s/%s", base_path, relative_path);
-
-    struct stat path_stat;
-    // Получаем информацию о файле или директории
-    if (stat(full_path, &path_stat) != 0) {
-        perror("stat"); // Выводим сообщение об ошибке, если не удалось получить информацию
-        return;
-    }
-
-    // Определяем тип записи: файл или директория
-    uint8_t entry_type = S_ISDIR(path_stat.st_mode) ? DIRECTORY_ENTRY : FILE_ENTRY;
-    uint16_t path_length = strlen(relative_path); // Длина относительного пути
-
-    // Записываем тип записи и длину пути в архив
-    fwrite(&entry_type, sizeof(uint8_t), 1, archive);
-    fwrite(&path_length, sizeof(uint16_t), 1, archive);
-    fwrite(relative_path, sizeof(char), path_length, archive); // Записываем относительный путь
-
-    if (S_ISREG(path_stat.st_mode)) { // Если запись является файлом
-        FILE *in = fopen(full_path, "rb"); // Открываем файл для чтения
-        if (!in) {
-            perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть файл
-            return;
-        }
-
-        FILE *temp = tmpfile(); // Создаем временный файл для хранения сжатых данных
-        if (!temp) {
-            perror("tmpfile"); // Выводим сообщение об ошибке, если не удалось создать временный файл
-            fclose(in);
-            return;
-        }
-
-        rle_encode_file(in, temp); // Кодируем файл с помощью RLE и записываем в временный файл
-        fclose(in); // Закрываем исходный файл
-
-        uint64_t compressed_size = ftell(temp);   // Получаем размер сжатого файла
-        fseek(temp, 0, SEEK_SET);                 // Возвращаемся в начало временного файла
-        uint64_t original_size = path_stat.st_size; // Получаем размер исходного файла
-
-        // Записываем размеры файлов в архив
-        fwrite(&original_size, sizeof(uint64_t), 1, archive);   // Оригинальный размер файла
-        fwrite(&compressed_size, sizeof(uint64_t), 1, archive); // Сжатый размер файла
-
-        // Копируем сжатые данные из временного файла в архив
-        char buffer[BUFFER_SIZE];
-        size_t bytes;
-        while ((bytes = fread(buffer, 1, BUFFER_SIZE, temp)) > 0) {
-            fwrite(buffer, 1, bytes, archive);
-        }
-        fclose(temp); // Закрываем временный файл
-    }
-}
-
-// Рекурсивная функция для упаковки директории и ее содержимого
-void pack_directory(FILE *archive, const char *base_path, const char *relative_path) {
-    char full_path[PATH_MAX];
-    // Формируем полный путь к текущей директории или файлу
-    snprintf(full_path, sizeof(full_path), "%s/%s", base_path, relative_path);
-
-    struct stat path_stat;
-    // Получаем информацию о текущей директории или файле
-    if (stat(full_path, &path_stat) != 0) {
-        perror("stat"); // Выводим сообщение об ошибке, если не удалось получить информацию
-        return;
-    }
-
-    // Записываем текущую запись в архив
-    write_entry(archive, base_path, relative_path);
-
-    if (S_ISDIR(path_stat.st_mode)) { // Если текущая запись является директорией
-        DIR *dir = opendir(full_path); // Открываем директорию для чтения
-        if (!dir) {
-            perror("opendir"); // Выводим сообщение об ошибке, если не удалось открыть директорию
-            return;
-        }
-
-        struct dirent *entry;
-        // Проходим по всем записям в директории
-        while ((entry = readdir(dir)) != NULL) {
-            // Пропускаем текущую и родительскую директории
-            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-                char child_relative_path[PATH_MAX];
-                // Формируем относительный путь к вложенной записи
-                snprintf(child_relative_path, sizeof(child_relative_path), "%s/%s", relative_path, entry->d_name);
-                // Рекурсивно пакуем вложенную директорию или файл
-                pack_directory(archive, base_path, child_relative_path);
+// Функция для разбора общих параметров, идущих после опции.
+// Распознанные параметры удаляются из argv, чтобы остались только позиционные аргументы.
+int parse_options(int *argc, char *argv[]) {
+    int kept = 2; // argv[0] и опция остаются на месте
+    for (int i = 2; i < *argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            char *end;
+            long value = i + 1 < *argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (value < 1 || value > SA_MAX_THREADS || *end != '\0') {
+                fprintf(stderr, "Ошибка: неверное число потоков\n");
+                return -1;
             }
+            options.threads = (int)value;
+            i++; // Пропускаем значение параметра
+        } else if (strcmp(argv[i], "-inode") == 0) {
+            options.inode_order = 1; // Флаг без значения
+        } else if (strcmp(argv[i], "-hash") == 0) {
+            options.content_hashing = 1; // Флаг без значения
+        } else if (strcmp(argv[i], "-nodedup") == 0) {
+            options.deduplicate = 0; // Флаг без значения
+        } else if (strcmp(argv[i], "-solid") == 0) {
+            options.solid_blocks = 1; // Флаг без значения
+        } else if (strcmp(argv[i], "-hardlink") == 0) {
+            options.hardlink_duplicates = 1; // Флаг без значения
+        } else if (strcmp(argv[i], "-b") == 0) {
+            if (i + 1 >= *argc || sa_parse_size(argv[i + 1], SA_MIN_BUFFER_SIZE, &options.buffer_size) != 0) {
+                fprintf(stderr, "Ошибка: неверный размер буфера\n");
+                return -1;
+            }
+            i++; // Пропускаем значение параметра
+        } else {
+            argv[kept++] = argv[i]; // Позиционный аргумент
         }
-        closedir(dir); // Закрываем директорию
     }
+    *argc = kept;
+    return 0;
 }
 
-// Функция для архивирования файлов и директорий
-void pack(const char *input_path, char *archive_path) {
-    // Добавляем расширение .sa к имени архива, если оно отсутствует
-    add_extension_if_missing(archive_path, ARCHIVE_EXTENSION);
-
-    FILE *archive = fopen(archive_path, "wb"); // Открываем архив для записи в бинарном режиме
-    if (!archive) {
-        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
-        return;
-    }
-
-    // Получаем абсолютный путь к входному файлу или директории
-    char *input_realpath = realpath(input_path, NULL);
-    if (!input_realpath) {
-        perror("realpath"); // Выводим сообщение об ошибке, если не удалось получить абсолютный путь
-        fclose(archive);
-        return;
-    }
-
-    // Создаем копии строк, так как функции dirname() и basename() могут модифицировать исходные строки
-    char *input_dirname = strdup(input_realpath);
-    char *input_basename = strdup(input_realpath);
-    input_dirname = dirname(input_dirname);    // Получаем родительскую директорию
-    input_basename = basename(input_basename); // Получаем имя входного файла или директории
-
-    // Начинаем упаковку с родительской директории и относительного пути, содержащего имя входного файла/директории
-    pack_directory(archive, input_dirname, input_basename);
-
-    free(input_realpath); // Освобождаем выделенную память
-    fclose(archive);      // Закрываем архив
-}
-
-// Функция для разархивации архива в указанную директорию
-void unpack(const char *archive_path, const char *output_folder) {
-    // Проверяем, имеет ли файл архива правильное расширение
+// Функция для проверки расширения архива, который читается
+int check_archive_extension(const char *archive_path) {
     if (!has_correct_extension(archive_path, ARCHIVE_EXTENSION)) {
         fprintf(stderr, "Ошибка: архив должен иметь расширение %s\n", ARCHIVE_EXTENSION);
-        return;
+        return -1;
     }
+    return 0;
+}
 
-    FILE *archive = fopen(archive_path, "rb"); // Открываем архив для чтения в бинарном режиме
-    if (!archive) {
-        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
-        return;
-    }
-
-    // Создаем выходную директорию, если она не существует
-    if (create_directory(output_folder) != 0) {
-        fclose(archive);
-        return;
-    }
-
-    // Читаем записи из архива и восстанавливаем файлы и директории
-    while (1) {
-        uint8_t entry_type;
-        // Читаем тип записи (файл или директория)
-        if (fread(&entry_type, sizeof(uint8_t), 1, archive) == 0) break; // Если достигнут конец архива, выходим из цикла
-
-        uint16_t path_length;
-        // Читаем длину относительного пути
-        fread(&path_length, sizeof(uint16_t), 1, archive);
-
-        char relative_path[PATH_MAX];
-        // Читаем относительный путь
-        fread(relative_path, sizeof(char), path_length, archive);
-        relative_path[path_length] = '\0'; // Добавляем завершающий нулевой символ
-
-        char full_path[PATH_MAX];
-        // Формируем полный путь к файлу или директории в выходной директории
-        snprintf(full_path, sizeof(full_path), "%s/%s", output_folder, relative_path);
-
-        if (entry_type == DIRECTORY_ENTRY) { // Если запись является директорией
-            create_directory(full_path); // Создаем директорию
-        } else if (entry_type == FILE_ENTRY) { // Если запись является файлом
-            uint64_t original_size, compressed_size;
-            // Читаем оригинальный и сжатый размеры файла
-            fread(&original_size, sizeof(uint64_t), 1, archive);
-            fread(&compressed_size, sizeof(uint64_t), 1, archive);
-
-            FILE *out = fopen(full_path, "wb"); // Открываем файл для записи
-            if (!out) {
-                perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть файл
-                fclose(archive);
-                return;
-            }
-
-            FILE *temp = tmpfile(); // Создаем временный файл для хранения сжатых данных
-            if (!temp) {
-                perror("tmpfile"); // Выводим сообщение об ошибке, если не удалось создать временный файл
-                fclose(out);
-                fclose(archive);
-                return;
-            }
-
-            // Читаем сжатые данные из архива и записываем во временный файл
-            char buffer[BUFFER_SIZE];
-            size_t bytes_remaining = compressed_size;
-            while (bytes_remaining > 0) {
-                size_t bytes_to_read = bytes_remaining > BUFFER_SIZE ? BUFFER_SIZE : bytes_remaining;
-                fread(buffer, 1, bytes_to_read, archive);
-                fwrite(buffer, 1, bytes_to_read, temp);
-                bytes_remaining -= bytes_to_read;
-            }
-
-            fseek(temp, 0, SEEK_SET); // Возвращаемся в начало временного файла
-            rle_decode_file(temp, out); // Декодируем данные из временного файла и записываем в выходной файл
-
-            fclose(out);  // Закрываем выходной файл
-            fclose(temp); // Закрываем временный файл
-        }
+// Функция для получения пути создаваемого архива: к имени добавляется расширение .sa, если его нет
+int make_archive_path(char *archive_path, const char *name) {
+    if (strlen(name) + strlen(ARCHIVE_EXTENSION) >= PATH_MAX) {
+        fprintf(stderr, "Ошибка: слишком длинный путь к архиву\n");
+        return -1;
     }
-    fclose(archive); // Закрываем архив
+    strcpy(archive_path, name);
+    add_extension_if_missing(archive_path, ARCHIVE_EXTENSION);
+    return 0;
 }
 
 // Основная функция программы
 int main(int argc, char *argv[]) {
+    char archive_path[PATH_MAX];              // Буфер для пути создаваемого архива с расширением
     char default_archive_path[PATH_MAX];      // Буфер для хранения пути к архиву по умолчанию
     char default_output_folder[PATH_MAX];     // Буфер для хранения пути к выходной папке по умолчанию
+    int result = 0;                           // Результат операции библиотеки
 
     const char *home_dir = get_home_directory();  // Получаем домашнюю директорию пользователя
 
+    // Отделяем общие параметры от позиционных аргументов; число потоков по умолчанию выбирает библиотека
+    sa_options_init(&options);
+    if (argc >= 2 && parse_options(&argc, argv) != 0) {
+        return 1;
+    }
+
     if (argc < 3) { // Проверяем количество аргументов командной строки
         print_usage(argv[0]); // Выводим инструкцию по использованию программы
         return 1;
@@ -337,13 +153,36 @@ int main(int argc, char *argv[]) {
             print_usage(argv[0]);
             return 1;
         }
-        pack(argv[2], argv[3]); // Упаковываем указанный файл или директорию в архив
+        // Упаковываем указанный файл или директорию в архив
+        result = make_archive_path(archive_path, argv[3]) == 0 ? sa_pack(argv[2], archive_path, &options) : -1;
     } else if (strcmp(argv[1], "-unpack") == 0) {
         if (argc != 4) {
             print_usage(argv[0]);
             return 1;
         }
-        unpack(argv[2], argv[3]); // Разархивируем архив в указанную директорию
+        // Разархивируем архив в указанную директорию
+        result = check_archive_extension(argv[2]) == 0 ? sa_unpack(argv[2], argv[3], &options) : -1;
+    } else if (strcmp(argv[1], "-list") == 0) {
+        if (argc != 3) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        result = sa_list(argv[2], stdout); // Выводим содержимое архива по его каталогу
+    } else if (strcmp(argv[1], "-extract") == 0) {
+        if (argc < 4 || argc > 5) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        // Извлекаем запись в указанную папку или в текущую директорию
+        result = sa_extract(argv[2], argv[3], argc == 5 ? argv[4] : ".", &options);
+    } else if (strcmp(argv[1], "-update") == 0) {
+        if (argc != 5) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        // Упаковываем заново, перенося неизменившиеся файлы
+        result = check_archive_extension(argv[2]) == 0 && make_archive_path(archive_path, argv[4]) == 0
+                 ? sa_update(argv[2], argv[3], archive_path, &options) : -1;
     } else if (strcmp(argv[1], "-pauto") == 0) {
         if (argc < 3 || argc > 4) {
             print_usage(argv[0]);
@@ -353,7 +192,8 @@ int main(int argc, char *argv[]) {
         const char *archive_name = (argc == 4) ? argv[3] : "default_archive.sa";
         // Формируем полный путь к архиву в папке Downloads
         snprintf(default_archive_path, sizeof(default_archive_path), "%s/Downloads/%s", home_dir, archive_name);
-        pack(argv[2], default_archive_path); // Автоматически упаковываем в папку Downloads
+        // Автоматически упаковываем в папку Downloads
+        result = make_archive_path(archive_path, default_archive_path) == 0 ? sa_pack(argv[2], archive_path, &options) : -1;
     } else if (strcmp(argv[1], "-unauto") == 0) {
         if (argc < 3 || argc > 4) {
             print_usage(argv[0]);
@@ -363,11 +203,12 @@ int main(int argc, char *argv[]) {
         const char *folder_name = (argc == 4) ? argv[3] : "unpacked_folder";
         // Формируем полный путь к выходной папке в папке Downloads
         snprintf(default_output_folder, sizeof(default_output_folder), "%s/Downloads/%s", home_dir, folder_name);
-        unpack(argv[2], default_output_folder); // Автоматически разархивируем в папку Downloads
+        // Автоматически разархивируем в папку Downloads
+        result = check_archive_extension(argv[2]) == 0 ? sa_unpack(argv[2], default_output_folder, &options) : -1;
     } else {
         print_usage(argv[0]); // Выводим инструкцию по использованию, если опция не распознана
         return 1;
     }
 
-    return 0; // Завершаем программу с кодом 0 (успешно)
-}
\ No newline at end of file
+    return result == 0 ? 0 : 1; // Код 1 сообщает, что операция не удалась
+}
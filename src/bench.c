@@ -0,0 +1,712 @@
+// Программа измерения производительности архиватора.
+// Компонуется с той же libsimplearchiver, что и archiver: кодеки блоков вызываются напрямую
+// через внутренний заголовок, поэтому измеряется ровно тот код, который попадает в архиватор.
+
+#define _XOPEN_SOURCE 700        // Объявление nftw() и флагов FTW_*
+
+#include <stdio.h>       // Стандартная библиотека ввода-вывода
+#include <stdlib.h>      // Стандартная библиотека общих функций
+#include <string.h>      // Библиотека для работы со строками
+#include <unistd.h>      // Библиотека для доступа к POSIX API
+#include <stdint.h>      // Библиотека для определения целочисленных типов с фиксированной шириной
+#include <errno.h>       // Библиотека для обработки ошибок
+#include <limits.h>      // Библиотека для определения пределов целочисленных типов (PATH_MAX)
+#include <fcntl.h>       // Библиотека для open() и флагов открытия файлов
+#include <time.h>        // Библиотека для clock_gettime()
+#include <sys/stat.h>    // Библиотека для работы с информацией о файлах и каталогах
+#include <ftw.h>         // Библиотека для обхода дерева при удалении рабочих директорий
+#include <stdarg.h>      // Библиотека для функций с переменным числом аргументов
+
+#include "simplearchiver.h"          // Библиотека архиватора
+#include "simplearchiver_internal.h" // Кодеки блоков библиотеки
+
+#define BENCH_SEED 0x5EED5EED5EED5EEDULL // Начальное состояние генератора: корпус одинаков при каждом запуске
+#define BENCH_DEFAULT_SIZE (32 << 20)    // Размер каждого крупного файла корпуса по умолчанию (32 МБ)
+#define BENCH_DEFAULT_FILES 5000         // Число мелких файлов корпуса по умолчанию
+#define BENCH_TINY_MAX_SIZE 2048         // Наибольший размер мелкого файла
+#define BENCH_TREE_FANOUT 4              // Число поддиректорий на каждом уровне дерева мелких файлов
+#define BENCH_TREE_DEPTH 8               // Глубина дерева мелких файлов
+#define BENCH_FILES_PER_DIR 8            // Число мелких файлов в одной директории
+#define BENCH_MIN_TIME 0.25              // Наименьшее время одного замера кодека, секунды
+#define BENCH_RUNS 3                     // Число повторов сквозного замера (берется лучший)
+#define BENCH_MB (1024.0 * 1024.0)       // Байтов в мегабайте для MB/s
+#define BENCH_MIN_SIZE 4096              // Наименьший размер крупного файла корпуса
+
+// Состояние потокового RLE-кодировщика между блоками
+typedef struct {
+    int prev;  // Байт незавершенной серии
+    int count; // Длина незавершенной серии (0 — серии нет)
+} rle_encoder_t;
+
+// Данные одного вида для замера кодеков
+typedef struct {
+    const char *name;       // Название вида данных
+    uint8_t *data;          // Данные
+    size_t size;            // Размер данных
+} bench_data_t;
+
+// Результат замера одного кодека на одном виде данных
+typedef struct {
+    const char *data;       // Вид данных
+    const char *codec;      // Кодек
+    double ratio;           // Отношение закодированного размера к исходному
+    double encode_mbps;     // Скорость кодирования, MB/s
+    double decode_mbps;     // Скорость декодирования, MB/s (0 — декодирования нет)
+} codec_result_t;
+
+// Результат сквозного замера упаковки или распаковки
+typedef struct {
+    const char *corpus;     // Корпус
+    const char *operation;  // pack или unpack
+    char options[32];       // Параметры запуска
+    double seconds;         // Лучшее время, секунды
+    double mbps;            // Скорость по объему исходных файлов, MB/s
+    uint64_t archive_size;  // Размер архива
+} e2e_result_t;
+
+// Файл сгенерированного корпуса
+typedef struct {
+    char *path;             // Путь относительно корня корпуса
+    uint64_t size;          // Размер
+    uint64_t hash;          // Хеш содержимого для проверки распаковки
+} corpus_file_t;
+
+// Сгенерированный корпус для сквозных замеров
+typedef struct {
+    const char *name;       // Название корпуса
+    char root[PATH_MAX];    // Путь к корню корпуса
+    corpus_file_t *files;   // Файлы корпуса
+    size_t count;           // Число файлов
+    size_t capacity;        // Выделено места под файлы
+    uint64_t total_size;    // Суммарный размер файлов
+} corpus_t;
+
+// Кодек в замере: кодирование в dst емкостью cap и декодирование обратно
+typedef struct {
+    const char *name;                                                            // Название кодека
+    size_t (*encode)(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint8_t *codec); // Кодирование
+    int (*decode)(const uint8_t *src, size_t n, uint8_t codec, uint8_t *dst, size_t dst_size); // Декодирование
+} bench_codec_t;
+
+static uint64_t bench_state = BENCH_SEED; // Состояние генератора псевдослучайных чисел
+static codec_scratch_t bench_scratch;         // Рабочая память кодировщика для замеров кодеков
+
+// Функция генератора xorshift64*: быстрый и одинаковый на всех платформах
+static uint64_t bench_random(void) {
+    bench_state ^= bench_state >> 12;
+    bench_state ^= bench_state << 25;
+    bench_state ^= bench_state >> 27;
+    return bench_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Функция для текущего монотонного времени в секундах
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Функция для генерации данных с длинными сериями одинаковых байтов
+static void generate_runs(uint8_t *data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        uint64_t r = bench_random();
+        size_t run = 1 + (size_t)((r >> 8) % ((r & 1) ? 4096 : 64)); // Длинные серии вперемешку с короткими
+        if (run > size - i) run = size - i;
+        memset(data + i, (int)(r >> 56), run);
+        i += run;
+    }
+}
+
+// Функция для генерации несжимаемых случайных данных
+static void generate_random(uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t r = bench_random();
+        memcpy(data + i, &r, size - i < 8 ? size - i : 8);
+    }
+}
+
+// Функция для генерации текста из слов словаря с неравномерными частотами
+static void generate_text(uint8_t *data, size_t size) {
+    static const char *words[] = {
+        "the", "of", "and", "to", "in", "archive", "file", "block", "data", "is", "for", "with",
+        "directory", "compression", "buffer", "stream", "thread", "offset", "size", "entry",
+        "header", "table", "codec", "path", "chunk", "index", "copy", "write", "read", "run",
+        "length", "byte", "pack", "unpack", "solid", "hash", "match", "literal", "window", "page"
+    };
+    size_t word_count = sizeof(words) / sizeof(words[0]);
+    size_t i = 0, line = 0;
+    while (i < size) {
+        uint64_t r = bench_random();
+        size_t index = (size_t)(((r & 0xFFFF) * ((r >> 16) & 0xFFFF)) >> 16) % word_count; // Частые слова в начале словаря
+        const char *word = words[index];
+        size_t length = strlen(word);
+        for (size_t k = 0; k < length && i < size; k++) {
+            data[i++] = (uint8_t)word[k];
+        }
+        line += length + 1;
+        if (i < size) data[i++] = line > 72 ? '\n' : ' '; // Строки около 72 символов
+        if (line > 72) line = 0;
+    }
+}
+
+// Функция для кодирования блока с помощью RLE.
+// Серия, дошедшая до конца блока, остается в st и продолжается следующим блоком,
+// поэтому результат побайтно совпадает с кодированием всего потока целиком.
+// В dst должно помещаться 2 * n + 2 байт.
+static size_t rle_encode_block(rle_encoder_t *st, const uint8_t *src, size_t n, uint8_t *dst) {
+    uint8_t *out = dst;
+    size_t i = 0;
+
+    if (st->count > 0) { // Продолжаем серию из предыдущего блока
+        size_t room = RLE_MAX_RUN - st->count;
+        size_t run = sa_internal_rle_match_run(src, n < room ? n : room, (uint8_t)st->prev);
+        st->count += run;
+        i = run;
+        if (i == n) return 0; // Весь блок продолжил серию
+        *out++ = (uint8_t)st->count; // Записываем количество повторений
+        *out++ = (uint8_t)st->prev;  // Записываем сам символ
+        st->count = 0;
+    }
+
+    while (i < n) {
+        uint8_t byte = src[i];
+        size_t limit = n - i < RLE_MAX_RUN ? n - i : RLE_MAX_RUN;
+        size_t run = 1;
+        // Векторное ядро вызываем только для настоящих серий, одиночные байты обрабатываем сразу
+        if (run < limit && src[i + 1] == byte) {
+            run = 2 + sa_internal_rle_match_run(src + i + 2, limit - 2, byte);
+        }
+        if (i + run == n) { // Серия может продолжиться в следующем блоке
+            st->prev = byte;
+            st->count = (int)run;
+            break;
+        }
+        *out++ = (uint8_t)run;
+        *out++ = byte;
+        i += run;
+    }
+    return out - dst;
+}
+
+// Функция для записи незавершенной серии в конце потока
+static size_t rle_encode_finish(rle_encoder_t *st, uint8_t *dst) {
+    if (st->count == 0) return 0; // Поток был пустым
+    dst[0] = (uint8_t)st->count;
+    dst[1] = (uint8_t)st->prev;
+    st->count = 0;
+    return 2;
+}
+
+// Функция для кодирования буфера целиком с помощью RLE. Архиватор больше не пишет блоки RLE,
+// кодировщик остается здесь для сравнения с прежним форматом.
+// В dst должно помещаться 2 * n байт; возвращает размер закодированных данных.
+static size_t rle_encode_buffer(const uint8_t *src, size_t n, uint8_t *dst) {
+    rle_encoder_t st = {0, 0};
+    size_t encoded = rle_encode_block(&st, src, n, dst);
+    return encoded + rle_encode_finish(&st, dst + encoded);
+}
+
+// Функция для форматирования пути в буфер PATH_MAX; возвращает -1, если путь не помещается
+static int format_path(char *path, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(path, PATH_MAX, format, args);
+    va_end(args);
+    if (length < 0 || length >= PATH_MAX) {
+        fprintf(stderr, "Ошибка: слишком длинный путь\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для записи буфера в новый файл
+static int write_file(const char *path, const uint8_t *data, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    int result = sa_internal_write_at(fd, data, size, 0);
+    close(fd);
+    return result;
+}
+
+// Функция для добавления файла в список корпуса
+static int corpus_add(corpus_t *corpus, const char *path, const uint8_t *data, size_t size) {
+    if (corpus->count == corpus->capacity) {
+        size_t capacity = corpus->capacity ? corpus->capacity * 2 : 256;
+        corpus_file_t *files = realloc(corpus->files, capacity * sizeof(corpus_file_t));
+        if (!files) {
+            perror("realloc");
+            return -1;
+        }
+        corpus->files = files;
+        corpus->capacity = capacity;
+    }
+    corpus_file_t *file = &corpus->files[corpus->count++];
+    file->path = strdup(path);
+    file->size = size;
+    file->hash = sa_internal_content_hash(data, size, 0);
+    corpus->total_size += size;
+    return 0;
+}
+
+// Функция для создания корпуса крупных файлов: серии, случайные данные и текст
+static int generate_large_corpus(corpus_t *corpus, const bench_data_t *data, size_t data_count) {
+    if (sa_internal_create_directory(corpus->root) != 0) return -1;
+    for (size_t i = 0; i < data_count; i++) {
+        char path[PATH_MAX];
+        if (format_path(path, "%s/%s.bin", corpus->root, data[i].name) != 0) return -1;
+        if (write_file(path, data[i].data, data[i].size) != 0) return -1;
+        if (format_path(path, "%s.bin", data[i].name) != 0 || corpus_add(corpus, path, data[i].data, data[i].size) != 0) return -1;
+    }
+    return 0;
+}
+
+// Функция для создания корпуса мелких файлов в глубоком дереве директорий.
+// Номер файла задает его директорию: цифры номера группы в системе счисления
+// с основанием BENCH_TREE_FANOUT становятся уровнями пути.
+static int generate_tiny_corpus(corpus_t *corpus, size_t file_count) {
+    if (sa_internal_create_directory(corpus->root) != 0) return -1;
+    uint8_t data[BENCH_TINY_MAX_SIZE];
+    for (size_t i = 0; i < file_count; i++) {
+        char relative[PATH_MAX] = "", directory[PATH_MAX];
+        size_t group = i / BENCH_FILES_PER_DIR;
+        for (int level = 0; level < BENCH_TREE_DEPTH && (level == 0 || group > 0); level++) {
+            size_t length = strlen(relative);
+            snprintf(relative + length, sizeof(relative) - length, "%sd%zu", level ? "/" : "", group % BENCH_TREE_FANOUT);
+            group /= BENCH_TREE_FANOUT;
+            if (format_path(directory, "%s/%s", corpus->root, relative) != 0 || sa_internal_create_directory(directory) != 0) return -1;
+        }
+        char file_relative[PATH_MAX];
+        if (format_path(file_relative, "%s/f%zu.txt", relative, i) != 0) return -1;
+
+        size_t size = (size_t)(bench_random() % BENCH_TINY_MAX_SIZE);
+        if (i % 4 == 3) {
+            generate_random(data, size); // Каждый четвертый файл несжимаемый
+        } else {
+            generate_text(data, size);
+        }
+
+        char path[PATH_MAX];
+        if (format_path(path, "%s/%s", corpus->root, file_relative) != 0) return -1;
+        if (write_file(path, data, size) != 0 || corpus_add(corpus, file_relative, data, size) != 0) return -1;
+    }
+    return 0;
+}
+
+// Функция для проверки распакованного корпуса: каждый файл должен совпасть по размеру и хешу
+static int verify_corpus(const corpus_t *corpus, const char *output_root) {
+    for (size_t i = 0; i < corpus->count; i++) {
+        char path[PATH_MAX];
+        if (format_path(path, "%s/%s", output_root, corpus->files[i].path) != 0) return -1;
+        int fd = open(path, O_RDONLY);
+        struct stat file_stat;
+        if (fd < 0 || fstat(fd, &file_stat) != 0 || (uint64_t)file_stat.st_size != corpus->files[i].size) {
+            fprintf(stderr, "Ошибка: распакованный файл %s отсутствует или имеет другой размер\n", path);
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        uint8_t *data = malloc(corpus->files[i].size ? corpus->files[i].size : 1);
+        size_t bytes = data ? sa_internal_read_chunk(fd, data, corpus->files[i].size, 0) : 0;
+        int same = data && bytes == corpus->files[i].size && sa_internal_content_hash(data, bytes, 0) == corpus->files[i].hash;
+        free(data);
+        close(fd);
+        if (!same) {
+            fprintf(stderr, "Ошибка: распакованный файл %s отличается от исходного\n", path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Функция обратного вызова nftw: удаляет файл или уже опустевшую директорию
+static int remove_callback(const char *path, const struct stat *sb, int type, struct FTW *ftw) {
+    (void)sb;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// Функция для рекурсивного удаления директории
+static void remove_tree(const char *path) {
+    nftw(path, remove_callback, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+// Обертки кодеков с общей сигнатурой для таблицы замеров
+static size_t bench_rle_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint8_t *codec) {
+    (void)cap;
+    *codec = CODEC_RLE;
+    return rle_encode_buffer(src, n, dst); // Прежний формат: пары (счетчик, байт), худший случай 2n
+}
+
+static size_t bench_packbits_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint8_t *codec) {
+    *codec = CODEC_PACKBITS;
+    return sa_internal_packbits_encode(src, n, dst, cap);
+}
+
+static size_t bench_lz_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint8_t *codec) {
+    *codec = CODEC_LZ;
+    return sa_internal_lz_encode(src, n, dst, cap, bench_scratch.lz_table);
+}
+
+static size_t bench_adaptive_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint8_t *codec) {
+    (void)cap;
+    chunk_info_t info;
+    size_t encoded = sa_internal_encode_chunk(src, n, dst, &info, &bench_scratch);
+    *codec = info.codec;
+    return encoded ? encoded : n; // Блок без сжатия хранится как есть
+}
+
+static size_t bench_hash(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint8_t *codec) {
+    (void)cap;
+    uint64_t hash = sa_internal_content_hash(src, n, 0);
+    memcpy(dst, &hash, sizeof(hash));
+    *codec = CODEC_STORED;
+    return n; // Хеш не сжимает данные
+}
+
+static int bench_decode(const uint8_t *src, size_t n, uint8_t codec, uint8_t *dst, size_t dst_size) {
+    chunk_info_t info = {(uint32_t)dst_size, (uint32_t)n, codec, 0};
+    return sa_internal_decode_chunk(&info, src, dst);
+}
+
+// Функция для замера одного кодека на одном виде данных.
+// Данные обрабатываются блоками CHUNK_SIZE, как при упаковке; проход повторяется,
+// пока замер не займет хотя бы BENCH_MIN_TIME секунд.
+static int bench_codec(const bench_codec_t *codec, const bench_data_t *data, uint8_t *encoded, size_t *encoded_sizes,
+                       uint8_t *codecs, uint8_t *decoded, codec_result_t *result) {
+    size_t chunk_count = (data->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    size_t capacity = 2 * (size_t)CHUNK_SIZE + 64;
+    uint64_t bytes = 0, stored = 0;
+    double start = bench_now(), elapsed;
+
+    // Кодирование: в encoded остается результат последнего прохода для декодирования
+    do {
+        stored = 0;
+        for (size_t c = 0; c < chunk_count; c++) {
+            size_t offset = c * (size_t)CHUNK_SIZE;
+            size_t n = data->size - offset < CHUNK_SIZE ? data->size - offset : CHUNK_SIZE;
+            uint8_t *dst = encoded + c * capacity;
+            encoded_sizes[c] = codec->encode(data->data + offset, n, dst, capacity, &codecs[c]);
+            if (encoded_sizes[c] == 0 && n > 0) { // Результат не поместился: блок хранится как есть
+                encoded_sizes[c] = n;
+                codecs[c] = CODEC_STORED;
+            }
+            if (codecs[c] == CODEC_STORED && codec->decode) memcpy(dst, data->data + offset, n);
+            stored += encoded_sizes[c];
+        }
+        bytes += data->size;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_TIME);
+
+    result->data = data->name;
+    result->codec = codec->name;
+    result->ratio = data->size ? (double)stored / data->size : 0;
+    result->encode_mbps = bytes / BENCH_MB / elapsed;
+    result->decode_mbps = 0;
+    if (!codec->decode) return 0;
+
+    // Декодирование с проверкой, что данные восстановились без искажений
+    bytes = 0;
+    start = bench_now();
+    do {
+        for (size_t c = 0; c < chunk_count; c++) {
+            size_t offset = c * (size_t)CHUNK_SIZE;
+            size_t n = data->size - offset < CHUNK_SIZE ? data->size - offset : CHUNK_SIZE;
+            if (codec->decode(encoded + c * capacity, encoded_sizes[c], codecs[c], decoded + offset, n) != 0) {
+                fprintf(stderr, "Ошибка: кодек %s не восстановил данные %s\n", codec->name, data->name);
+                return -1;
+            }
+        }
+        bytes += data->size;
+        elapsed = bench_now() - start;
+    } while (elapsed < BENCH_MIN_TIME);
+    if (memcmp(decoded, data->data, data->size) != 0) {
+        fprintf(stderr, "Ошибка: кодек %s исказил данные %s\n", codec->name, data->name);
+        return -1;
+    }
+    result->decode_mbps = bytes / BENCH_MB / elapsed;
+    return 0;
+}
+
+// Функция для размера файла (0, если файла нет)
+static uint64_t file_size(const char *path) {
+    struct stat file_stat;
+    return stat(path, &file_stat) == 0 ? (uint64_t)file_stat.st_size : 0;
+}
+
+// Функция для сквозного замера упаковки корпуса: лучший из BENCH_RUNS запусков.
+// Возвращает -1, если упаковка не удалась: замер неудачного запуска ничего не значит.
+static int bench_pack(const corpus_t *corpus, const char *archive_path, int threads, int solid, e2e_result_t *result) {
+    double best = 0;
+    memset(result, 0, sizeof(*result)); // При ошибке в таблице останется строка с нулями
+    result->corpus = corpus->name;
+    result->operation = "pack";
+    snprintf(result->options, sizeof(result->options), "-j %d%s", threads, solid ? " -solid" : "");
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        sa_options_t options;
+        sa_options_init(&options);
+        options.threads = threads;
+        options.solid_blocks = solid;
+        remove(archive_path);
+        double start = bench_now();
+        if (sa_pack(corpus->root, archive_path, &options) != 0) {
+            fprintf(stderr, "Ошибка: не удалось упаковать корпус %s\n", corpus->name);
+            return -1;
+        }
+        double elapsed = bench_now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+
+    result->seconds = best;
+    result->mbps = corpus->total_size / BENCH_MB / best;
+    result->archive_size = file_size(archive_path);
+    return 0;
+}
+
+// Функция для сквозного замера распаковки архива с проверкой результата.
+// Возвращает -1, если распаковка не удалась хотя бы в одном запуске или результат неверен.
+static int bench_unpack(const corpus_t *corpus, const char *archive_path, const char *output_folder, int threads,
+                        const char *options, e2e_result_t *result) {
+    double best = 0;
+    memset(result, 0, sizeof(*result)); // При ошибке в таблице останется строка с нулями
+    result->corpus = corpus->name;
+    result->operation = "unpack";
+    snprintf(result->options, sizeof(result->options), "-j %d%s", threads, options);
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        sa_options_t unpack_options;
+        sa_options_init(&unpack_options);
+        unpack_options.threads = threads;
+        remove_tree(output_folder);
+        double start = bench_now();
+        if (sa_unpack(archive_path, output_folder, &unpack_options) != 0) {
+            fprintf(stderr, "Ошибка: не удалось распаковать корпус %s\n", corpus->name);
+            remove_tree(output_folder);
+            return -1;
+        }
+        double elapsed = bench_now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+
+    // Архив содержит корень корпуса под его именем
+    char output_root[PATH_MAX];
+    const char *slash = strrchr(corpus->root, '/');
+    int verified = format_path(output_root, "%s/%s", output_folder, slash ? slash + 1 : corpus->root) == 0
+                   ? verify_corpus(corpus, output_root) : -1;
+    remove_tree(output_folder);
+
+    result->seconds = best;
+    result->mbps = corpus->total_size / BENCH_MB / best;
+    result->archive_size = file_size(archive_path);
+    return verified;
+}
+
+// Функция для выбора рабочей директории по умолчанию: tmpfs, если он есть, иначе /tmp
+static const char *default_work_directory(void) {
+    struct stat dir_stat;
+    if (stat("/dev/shm", &dir_stat) == 0 && S_ISDIR(dir_stat.st_mode) && access("/dev/shm", W_OK) == 0) {
+        return "/dev/shm";
+    }
+    const char *tmpdir = getenv("TMPDIR");
+    return tmpdir && *tmpdir ? tmpdir : "/tmp";
+}
+
+// Функция для вывода результатов таблицей
+static void print_table(const codec_result_t *codecs, size_t codec_count, const e2e_result_t *e2e, size_t e2e_count,
+                        const char *work_directory, int threads) {
+    printf("Рабочая директория: %s, потоков: %d, блок: %d КБ\n\n", work_directory, threads, CHUNK_SIZE >> 10);
+    printf("%-8s %-9s %8s %12s %12s\n", "data", "codec", "ratio", "enc MB/s", "dec MB/s");
+    for (size_t i = 0; i < codec_count; i++) {
+        printf("%-8s %-9s %8.3f %12.1f ", codecs[i].data, codecs[i].codec, codecs[i].ratio, codecs[i].encode_mbps);
+        if (codecs[i].decode_mbps > 0) {
+            printf("%12.1f\n", codecs[i].decode_mbps);
+        } else {
+            printf("%12s\n", "-");
+        }
+    }
+
+    printf("\n%-8s %-9s %-14s %10s %10s %14s\n", "corpus", "operation", "options", "seconds", "MB/s", "archive bytes");
+    for (size_t i = 0; i < e2e_count; i++) {
+        printf("%-8s %-9s %-14s %10.4f %10.1f %14llu\n", e2e[i].corpus, e2e[i].operation, e2e[i].options,
+               e2e[i].seconds, e2e[i].mbps, (unsigned long long)e2e[i].archive_size);
+    }
+}
+
+// Функция для вывода строки JSON в кавычках: '"', '\\' и управляющие символы экранируются
+static void print_json_string(const char *text) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+// Функция для вывода результатов в JSON
+static void print_json(const codec_result_t *codecs, size_t codec_count, const e2e_result_t *e2e, size_t e2e_count,
+                       const char *work_directory, int threads) {
+    printf("{\n  \"work_directory\": ");
+    print_json_string(work_directory); // Путь задается пользователем и может содержать что угодно
+    printf(",\n  \"threads\": %d,\n  \"chunk_size\": %d,\n", threads, CHUNK_SIZE);
+    printf("  \"codec\": [\n");
+    for (size_t i = 0; i < codec_count; i++) {
+        printf("    {\"data\": \"%s\", \"codec\": \"%s\", \"ratio\": %.4f, \"encode_mbps\": %.1f, \"decode_mbps\": %.1f}%s\n",
+               codecs[i].data, codecs[i].codec, codecs[i].ratio, codecs[i].encode_mbps, codecs[i].decode_mbps,
+               i + 1 < codec_count ? "," : "");
+    }
+    printf("  ],\n  \"end_to_end\": [\n");
+    for (size_t i = 0; i < e2e_count; i++) {
+        printf("    {\"corpus\": \"%s\", \"operation\": \"%s\", \"options\": \"%s\", \"seconds\": %.4f, \"mbps\": %.1f, "
+               "\"archive_bytes\": %llu}%s\n",
+               e2e[i].corpus, e2e[i].operation, e2e[i].options, e2e[i].seconds, e2e[i].mbps,
+               (unsigned long long)e2e[i].archive_size, i + 1 < e2e_count ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+// Функция для вывода инструкции по использованию бенчмарка
+static void print_bench_usage(const char *program_name) {
+    printf("Использование: %s [параметры]\n", program_name);
+    printf("Параметры:\n");
+    printf("  -json                 Вывести результаты в JSON\n");
+    printf("  -size <размер>        Размер каждого крупного файла корпуса, например 8M (по умолчанию 32M)\n");
+    printf("  -files <N>            Число мелких файлов корпуса (по умолчанию %d)\n", BENCH_DEFAULT_FILES);
+    printf("  -dir <папка>          Рабочая директория (по умолчанию /dev/shm, если есть)\n");
+    printf("  -j <N>                Число потоков упаковки и распаковки (по умолчанию — число процессоров)\n");
+    printf("  -codec                Только замеры кодеков в памяти\n");
+}
+
+// Основная функция бенчмарка
+int main(int argc, char *argv[]) {
+    int json = 0, codec_only = 0, threads = 0;
+    size_t large_size = BENCH_DEFAULT_SIZE, tiny_count = BENCH_DEFAULT_FILES;
+    const char *work_directory = default_work_directory();
+
+    // Разбор параметров командной строки
+    for (int i = 1; i < argc; i++) {
+        char *end;
+        if (strcmp(argv[i], "-json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "-codec") == 0) {
+            codec_only = 1;
+        } else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc && sa_parse_size(argv[i + 1], BENCH_MIN_SIZE, &large_size) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "-files") == 0 && i + 1 < argc
+                   && (tiny_count = strtoul(argv[i + 1], &end, 10), *end == '\0')) {
+            i++;
+        } else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc) {
+            work_directory = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc
+                   && (threads = (int)strtol(argv[i + 1], &end, 10), *end == '\0' && threads >= 1 && threads <= SA_MAX_THREADS)) {
+            i++;
+        } else {
+            print_bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads == 0) { // По умолчанию используем все доступные процессоры
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus < 1 ? 1 : (cpus > SA_MAX_THREADS ? SA_MAX_THREADS : (int)cpus);
+    }
+    sa_internal_rle_init_kernels();
+
+    // Детерминированные данные трех видов
+    bench_data_t data[] = {
+        {"runs", malloc(large_size), large_size},
+        {"random", malloc(large_size), large_size},
+        {"text", malloc(large_size), large_size},
+    };
+    size_t data_count = sizeof(data) / sizeof(data[0]);
+    size_t chunk_count = (large_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    uint8_t *encoded = malloc(chunk_count * (2 * (size_t)CHUNK_SIZE + 64));
+    size_t *encoded_sizes = malloc(chunk_count * sizeof(size_t));
+    uint8_t *codecs = malloc(chunk_count);
+    uint8_t *decoded = malloc(large_size);
+    if (!data[0].data || !data[1].data || !data[2].data || !encoded || !encoded_sizes || !codecs || !decoded) {
+        perror("malloc");
+        return 1;
+    }
+    generate_runs(data[0].data, large_size);
+    generate_random(data[1].data, large_size);
+    generate_text(data[2].data, large_size);
+
+    // Замеры кодеков в памяти
+    static const bench_codec_t codec_table[] = {
+        {"rle", bench_rle_encode, bench_decode},
+        {"packbits", bench_packbits_encode, bench_decode},
+        {"lz", bench_lz_encode, bench_decode},
+        {"adaptive", bench_adaptive_encode, bench_decode},
+        {"hash", bench_hash, NULL},
+    };
+    size_t codec_table_count = sizeof(codec_table) / sizeof(codec_table[0]);
+    codec_result_t codec_results[sizeof(data) / sizeof(data[0]) * sizeof(codec_table) / sizeof(codec_table[0])];
+    size_t codec_result_count = 0;
+    int failed = 0;
+    for (size_t d = 0; d < data_count && !failed; d++) {
+        for (size_t c = 0; c < codec_table_count && !failed; c++) {
+            failed = bench_codec(&codec_table[c], &data[d], encoded, encoded_sizes, codecs, decoded,
+                                 &codec_results[codec_result_count++]) != 0;
+        }
+    }
+    free(encoded);
+    free(encoded_sizes);
+    free(codecs);
+    free(decoded);
+
+    // Сквозные замеры: корпус крупных файлов и корпус мелких файлов в глубоком дереве
+    e2e_result_t e2e_results[12];
+    size_t e2e_count = 0;
+    char work_root[PATH_MAX];
+    if (!failed && !codec_only && format_path(work_root, "%s/archiver-bench-%ld", work_directory, (long)getpid()) == 0
+        && sa_internal_create_directory(work_root) == 0) {
+        corpus_t corpora[2];
+        memset(corpora, 0, sizeof(corpora));
+        corpora[0].name = "large";
+        corpora[1].name = "tiny";
+        if (format_path(corpora[0].root, "%s/large", work_root) != 0 || format_path(corpora[1].root, "%s/tiny", work_root) != 0
+            || generate_large_corpus(&corpora[0], data, data_count) != 0 || generate_tiny_corpus(&corpora[1], tiny_count) != 0) {
+            failed = 1;
+        }
+
+        for (int k = 0; k < 2 && !failed; k++) {
+            char archive_path[PATH_MAX], solid_path[PATH_MAX], output_folder[PATH_MAX];
+            if (format_path(archive_path, "%s/%s.sa", work_root, corpora[k].name) != 0
+                || format_path(solid_path, "%s/%s-solid.sa", work_root, corpora[k].name) != 0
+                || format_path(output_folder, "%s/out", work_root) != 0) {
+                failed = 1;
+                break;
+            }
+            failed = bench_pack(&corpora[k], archive_path, 1, 0, &e2e_results[e2e_count++]) != 0
+                     || bench_pack(&corpora[k], archive_path, threads, 0, &e2e_results[e2e_count++]) != 0
+                     || bench_pack(&corpora[k], solid_path, threads, 1, &e2e_results[e2e_count++]) != 0
+                     || bench_unpack(&corpora[k], archive_path, output_folder, 1, "", &e2e_results[e2e_count++]) != 0
+                     || bench_unpack(&corpora[k], archive_path, output_folder, threads, "", &e2e_results[e2e_count++]) != 0
+                     || bench_unpack(&corpora[k], solid_path, output_folder, threads, " solid", &e2e_results[e2e_count++]) != 0;
+        }
+
+        for (int k = 0; k < 2; k++) {
+            for (size_t i = 0; i < corpora[k].count; i++) {
+                free(corpora[k].files[i].path);
+            }
+            free(corpora[k].files);
+        }
+        remove_tree(work_root);
+    }
+
+    if (json) {
+        print_json(codec_results, codec_result_count, e2e_results, e2e_count, work_directory, threads);
+    } else {
+        print_table(codec_results, codec_result_count, e2e_results, e2e_count, work_directory, threads);
+    }
+    for (size_t d = 0; d < data_count; d++) {
+        free(data[d].data);
+    }
+    return failed ? 1 : 0;
+}
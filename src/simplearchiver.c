@@ -0,0 +1,4556 @@
+#ifdef __linux__
+#define _GNU_SOURCE              // Объявление fallocate(), copy_file_range() и fopencookie() в Linux
+#endif
+
+#include <stdio.h>       // Стандартная библиотека ввода-вывода
+#include <stdlib.h>      // Стандартная библиотека общих функций
+#include <string.h>      // Библиотека для работы со строками
+#include <dirent.h>      // Библиотека для работы с каталогами
+#include <sys/stat.h>    // Библиотека для работы с информацией о файлах и каталогах
+#include <unistd.h>      // Библиотека для доступа к POSIX API
+#include <stdint.h>      // Библиотека для определения целочисленных типов с фиксированной шириной
+#include <errno.h>       // Библиотека для обработки ошибок
+#include <limits.h>      // Библиотека для определения пределов целочисленных типов
+#include <libgen.h>      // Библиотека для функций dirname() и basename()
+#include <fcntl.h>       // Библиотека для open() и флагов открытия файлов
+#include <time.h>        // Библиотека для вывода времени изменения записей
+#include <pthread.h>     // Библиотека POSIX-потоков (конвейер упаковки, выбор ядер)
+#include <sys/mman.h>    // Библиотека для отображения файлов в память (mmap)
+
+#define SA_BUILD_LIBRARY         // Функции API экспортируются из разделяемой библиотеки
+#include "simplearchiver.h"      // Открытый интерфейс библиотеки
+#include "simplearchiver_internal.h" // Кодеки блоков, общие с программой измерения производительности
+
+#ifdef __linux__
+#include <sys/sendfile.h> // Копирование между дескрипторами внутри ядра (sendfile)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>   // Интринсики SSE2/AVX2 для векторных ядер RLE
+#define RLE_HAVE_X86 1   // Доступны векторные ядра x86 с выбором во время выполнения
+#endif
+
+#define DEFAULT_BUFFER_SIZE (1 << 20) // Размер буфера ввода-вывода по умолчанию (1 МБ)
+#define MIN_BUFFER_SIZE SA_MIN_BUFFER_SIZE // Минимальный размер буфера ввода-вывода
+#define FILE_ENTRY 0x01         // Константа, обозначающая файл в архиве
+#define DIRECTORY_ENTRY 0x02    // Константа, обозначающая директорию в архиве
+#define CHUNKED_FILE_ENTRY 0x03 // Константа, обозначающая файл, разбитый на независимые блоки
+#define DUPLICATE_ENTRY 0x04    // Константа, обозначающая копию файла, уже записанного в архив
+#define SOLID_BLOCK_ENTRY 0x05  // Константа, обозначающая сплошной блок из нескольких мелких файлов
+#define SOLID_MEMBER_ENTRY 0x06 // Файл внутри сплошного блока (встречается только в центральном каталоге)
+#define STREAMED_FILE_ENTRY 0x07 // Файл неизвестного заранее размера: блоки с описанием перед каждым, затем нулевое описание
+#define PACKBITS_MAX_LITERAL 128 // Наибольшая группа литералов PackBits
+#define PACKBITS_MIN_RUN 3      // Наименьшая серия, которую выгодно кодировать повтором
+#define PACKBITS_MAX_RUN 130    // Наибольшая серия PackBits (управляющий байт 255)
+#define LZ_MIN_MATCH 4          // Наименьшая длина совпадения LZ
+#define LZ_MAX_OFFSET 65535     // Наибольшее расстояние до совпадения LZ
+#define LZ_WILDCOPY_SLACK 16    // Запас приемника для копирования словами с перекрытием за конец
+#define LZ_MIN_GAIN 4           // На сколько процентов исходного размера LZ должен обойти PackBits, чтобы его выбрали
+#define CODEC_SAMPLE_COUNT 8    // Число образцов, по которым выбирается кодек блока
+#define MAX_CHUNK_SIZE (256 << 20) // Наибольший размер блока, который принимает распаковка
+#define MMAP_MIN_SIZE (256 << 10) // Файлы меньше этого размера читаются через pread, а не отображаются
+#define SOLID_BLOCK_SIZE (1 << 20) // Наибольший объем файлов в одном сплошном блоке (1 МБ)
+#define SOLID_MAX_FILE_SIZE (64 << 10) // Файлы не больше этого размера собираются в сплошные блоки
+#define SOLID_MAX_MEMBERS 65535 // Наибольшее число файлов в одном сплошном блоке
+#define DEDUP_MIN_SIZE 64       // Файлы меньше этого размера не дедуплицируются: ссылка почти не короче данных
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL // Константы 64-битного хеша содержимого (XXH64)
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME5 0x27D4EB2F165667C5ULL
+#define INDEX_MAGIC "SAIX"      // Сигнатура завершающего блока с указателем на центральный каталог
+#define INDEX_VERSION 2         // Версия формата центрального каталога
+#define INDEX_VERSION_NO_HASH 1 // Первая версия каталога, записи которой не содержат хеша содержимого
+#define INDEX_TRAILER_SIZE 24   // Размер завершающего блока: смещение, число записей, версия, сигнатура
+#define CHUNKED_HEADER_SIZE 16  // Размер заголовка данных файла: исходный размер, размер блока, число блоков
+#define CHUNK_INFO_SIZE 9       // Размер описания блока в таблице: исходный размер, размер в архиве, кодек
+#define HASH_STACK_CHUNKS 256   // Число хешей блоков, которые sa_hash держит на стеке (данные до 1 ГБ)
+#define MAX_THREADS SA_MAX_THREADS // Максимальное число рабочих потоков
+#define PACK_QUEUE_PER_THREAD 4 // Длина очереди заданий упаковки на один рабочий поток
+#define PACK_MEMORY_BUDGET (256 << 20) // Предел объема исходных данных в очереди упаковки
+
+// Ядро декодирования пар (счетчик, байт) из src в dst
+typedef size_t (*rle_decode_fn)(const uint8_t *src, size_t n, size_t *consumed, uint8_t *dst, size_t cap);
+
+_Static_assert(sizeof(codec_scratch_t) == SA_CODEC_SCRATCH_SIZE, "SA_CODEC_SCRATCH_SIZE не совпадает с codec_scratch_t");
+
+// Запись центрального каталога: где в архиве лежит запись и что в ней
+typedef struct {
+    uint8_t entry_type;     // Тип записи
+    char *path;             // Относительный путь
+    uint64_t offset;        // Смещение заголовка записи от начала архива
+    uint64_t original_size; // Размер исходного файла
+    uint64_t stored_size;   // Размер закодированных данных в архиве
+    int64_t mtime;          // Время изменения (секунды Unix, 0 — неизвестно)
+    uint64_t hash;          // Хеш содержимого файла (0 — не вычислялся)
+} index_entry_t;
+
+// Центральный каталог архива
+typedef struct {
+    index_entry_t *entries; // Записи в порядке следования в архиве
+    size_t count;           // Число записей
+    size_t capacity;        // Выделено места под записи
+    uint64_t data_end;      // Конец области записей (начало каталога или конец файла)
+} archive_index_t;
+
+// Заголовок записи CHUNKED_FILE_ENTRY, прочитанный напрямую через pread
+typedef struct {
+    uint64_t original_size; // Размер восстановленного файла
+    uint32_t chunk_size;    // Размер блока
+    uint32_t chunk_count;   // Число блоков
+    chunk_info_t *chunks;   // Таблица блоков
+    uint64_t data_offset;   // Смещение данных первого блока в архиве
+} chunked_header_t;
+
+// Задание параллельной распаковки: запись целиком или один блок большого файла
+typedef struct {
+    size_t entry;           // Номер записи в каталоге
+    int whole_entry;        // 1 — запись целиком, 0 — один блок
+    chunk_info_t info;      // Описание блока
+    uint32_t chunk_index;   // Номер блока в файле
+    uint64_t data_offset;   // Смещение данных блока в архиве
+    uint64_t out_offset;    // Смещение блока в восстановленном файле
+    uint64_t file_size;     // Итоговый размер файла
+} unpack_task_t;
+
+// Общее состояние рабочих потоков распаковки
+typedef struct {
+    const char *archive_path;     // Путь к архиву (для записей старого формата)
+    const sa_options_t *options;  // Параметры распаковки
+    int fd;                       // Дескриптор архива, читаемый через pread
+    const uint8_t *map;           // Архив, отображенный в память (NULL — читаем через pread)
+    uint64_t map_size;            // Размер отображения архива
+    const char *output_folder;    // Выходная директория
+    const archive_index_t *index; // Каталог архива
+    unpack_task_t *tasks;         // Задания
+    size_t task_count;            // Число заданий
+    size_t next_task;             // Следующее невыданное задание
+    int failed;                   // Хотя бы одно задание завершилось ошибкой
+    pthread_mutex_t lock;         // Мьютекс выдачи заданий
+} unpack_pool_t;
+
+// Архив, открытый на запись: поток и каталог уже записанных записей
+typedef struct {
+    FILE *file;             // Поток архива
+    archive_index_t index;  // Каталог, который будет дописан в конец архива
+    const sa_options_t *options; // Параметры упаковки
+    int failed;             // Запись не удалась: архив неполон, упаковка завершится ошибкой
+} archive_writer_t;
+
+// Файл, упаковываемый поблочно: общий для всех заданий его блоков
+typedef struct {
+    char *relative_path;    // Относительный путь записи
+    int64_t mtime;          // Время изменения исходного файла
+    size_t index_slot;      // Номер записи файла в центральном каталоге
+    int fd;                 // Дескриптор исходного файла
+    const uint8_t *map;     // Файл, отображенный в память (NULL — читаем через pread)
+    uint64_t source_size;   // Размер файла на момент обхода
+    uint32_t chunk_count;   // Число блоков (по размеру на момент обхода)
+    chunk_info_t *chunks;   // Таблица блоков, заполняется писателем
+    uint64_t original_size; // Сумма фактически прочитанных байтов
+    off_t table_offset;     // Смещение заголовка с таблицей блоков в архиве
+} pack_file_t;
+
+// Предыдущий архив в режиме -update: из него переносятся записи неизменившихся файлов
+typedef struct {
+    int fd;                   // Дескриптор предыдущего архива, читаемый через pread
+    archive_index_t index;    // Каталог предыдущего архива
+    index_entry_t **by_path;  // Записи каталога, отсортированные по пути
+    size_t count;             // Число записей в by_path
+    uint8_t *buffer;          // Буфер для хеширования файлов без отображения (CHUNK_SIZE байт)
+    size_t *new_slots;        // Номер перенесенной записи в новом каталоге по строке старого (SIZE_MAX — не перенесена)
+} previous_archive_t;
+
+// Запись предыдущего архива, которая переносится в новый архив байт в байт без перекодирования
+typedef struct {
+    char *relative_path;      // Относительный путь записи
+    int64_t mtime;            // Время изменения текущего файла
+    uint64_t original_size;   // Размер файла
+    uint64_t stored_size;     // Суммарный размер блоков
+    uint64_t hash;            // Хеш содержимого (0 — неизвестен)
+    int fd;                   // Дескриптор предыдущего архива
+    uint64_t payload_offset;  // Смещение заголовка блоков записи (сразу после пути) в предыдущем архиве
+    uint64_t payload_size;    // Размер заголовка, таблицы и данных блоков
+} reused_entry_t;
+
+// Копия файла, уже записанного в этот архив: вместо данных хранится ссылка на первую копию
+typedef struct {
+    char *relative_path;      // Относительный путь копии
+    int64_t mtime;            // Время изменения копии
+    uint64_t size;            // Размер файла
+    uint64_t hash;            // Хеш содержимого
+    size_t original_slot;     // Номер записи первой копии в каталоге
+} duplicate_entry_t;
+
+// Файл, уже записанный в архив, — возможный оригинал для следующих копий
+typedef struct {
+    uint64_t size;            // Размер файла
+    uint64_t hash;            // Хеш содержимого (0 — еще не вычислялся)
+    size_t slot;              // Номер записи файла в каталоге
+    char *relative_path;      // Путь от базовой директории обхода для повторного открытия
+    size_t next;              // Следующий файл в цепочке корзины (SIZE_MAX — конец)
+} dedup_file_t;
+
+// Таблица дедупликации: файлы архива, сгруппированные по размеру.
+// Хеш считается только у файлов, размер которых совпал с размером другого файла,
+// поэтому файлы с уникальным размером повторно не читаются.
+typedef struct {
+    dedup_file_t *files;      // Записанные файлы
+    size_t count;             // Число файлов
+    size_t capacity;          // Выделено места под файлы
+    size_t *buckets;          // Первый файл корзины по размеру (SIZE_MAX — пусто)
+    size_t bucket_count;      // Число корзин (степень двойки)
+    int base_fd;              // Дескриптор базовой директории обхода
+    uint8_t *buffer;          // Буфер для хеширования файлов без отображения (CHUNK_SIZE байт)
+    uint8_t *original_buffer; // Буфер для чтения первой копии при сравнении (CHUNK_SIZE байт)
+} dedup_table_t;
+
+// Файл внутри сплошного блока
+typedef struct {
+    char *relative_path;      // Относительный путь файла
+    uint32_t size;            // Размер файла
+    int64_t mtime;            // Время изменения
+    uint64_t hash;            // Хеш содержимого (0 — не вычислялся)
+} solid_member_t;
+
+// Сплошной блок: мелкие файлы подряд в одном буфере, который кодируется как один блок.
+// Обход наполняет блок, а заполненный блок уходит в конвейер одним заданием.
+typedef struct {
+    uint8_t *data;            // Содержимое файлов подряд (до SOLID_BLOCK_SIZE байт)
+    size_t size;              // Заполнено байтов
+    solid_member_t *members;  // Таблица файлов блока
+    uint32_t count;           // Число файлов
+    uint32_t capacity;        // Выделено места под таблицу
+    int failed;               // Файл блока укоротился во время упаковки: упаковка завершится ошибкой
+} solid_block_t;
+
+// Сплошной блок предыдущего архива, который переносится целиком, если не изменился ни один его файл.
+// Обход откладывает совпавшие файлы блока; когда совпали все, блок копируется без перекодирования,
+// а если какой-то файл изменился или пропал, отложенные файлы открываются заново и кодируются.
+typedef struct {
+    size_t block_row;         // Строка блока в каталоге предыдущего архива (файлы блока — следом)
+    uint32_t count;           // Число файлов в блоке
+    uint32_t matched;         // Сколько файлов блока по порядку оказались неизменившимися
+    solid_member_t *members;  // Неизменившиеся файлы с текущими временем изменения и хешем
+    int fd;                   // Дескриптор предыдущего архива
+    uint64_t original_size;   // Суммарный размер файлов блока
+    uint64_t stored_size;     // Размер закодированных данных блока
+    uint64_t payload_offset;  // Смещение описания закодированного блока в предыдущем архиве
+} reused_block_t;
+
+// Задание конвейера упаковки: директория или один блок файла
+typedef struct {
+    uint8_t entry_type;     // CHUNKED_FILE_ENTRY или DIRECTORY_ENTRY
+    char *relative_path;    // Относительный путь директории
+    int64_t mtime;          // Время изменения директории
+    pack_file_t *file;      // Файл, которому принадлежит блок
+    reused_entry_t *reuse;  // Запись, переносимая из предыдущего архива (NULL — кодируем файл)
+    duplicate_entry_t *duplicate; // Копия уже записанного файла (NULL — кодируем файл)
+    solid_block_t *solid;   // Сплошной блок мелких файлов (NULL — кодируем файл)
+    reused_block_t *reuse_block; // Сплошной блок, переносимый из предыдущего архива (NULL — кодируем файл)
+    uint32_t chunk_index;   // Номер блока в файле
+    uint64_t budget;        // Сколько байтов задание занимает в бюджете памяти очереди
+    int done;               // Задание обработано рабочим потоком
+    int failed;             // Рабочий поток не смог закодировать блок
+    uint8_t *data;          // Закодированные данные блока
+    chunk_info_t info;      // Размеры и кодек блока
+} pack_job_t;
+
+// Конвейер упаковки: обход ставит задания в ограниченную очередь, рабочие потоки
+// сжимают их параллельно, а единственный писатель выводит их в порядке обхода
+typedef struct {
+    archive_writer_t *writer; // Архив, в который пишет писатель
+    previous_archive_t *previous; // Предыдущий архив в режиме -update (NULL при обычной упаковке)
+    dedup_table_t *dedup;     // Таблица дедупликации (NULL с опцией -nodedup)
+    solid_block_t *solid;     // Наполняемый сплошной блок (NULL без опции -solid)
+    reused_block_t *reuse_block; // Сплошной блок предыдущего архива, файлы которого сейчас откладываются
+    int base_fd;              // Дескриптор базовой директории обхода (для повторного открытия файлов)
+    size_t submitted;         // Число записей, поставленных в очередь (номер следующей записи в каталоге)
+    int threads;              // Число рабочих потоков (1 — без конвейера)
+    pack_job_t *jobs;         // Кольцевой буфер заданий
+    size_t capacity;          // Емкость кольцевого буфера
+    size_t head;              // Следующее задание для записи
+    size_t claim;             // Следующее задание для сжатия
+    size_t tail;              // Следующее свободное место
+    uint64_t in_flight_bytes; // Объем исходных данных заданий в очереди
+    int finished;             // Обход завершен, новых заданий не будет
+    int walk_failed;          // Обход пропустил элементы из-за нехватки памяти: архив неполон
+    pthread_mutex_t lock;     // Мьютекс, защищающий очередь
+    pthread_cond_t not_full;  // Сигнал обходу: в очереди освободилось место
+    pthread_cond_t work_ready; // Сигнал рабочим: появилось новое задание
+    pthread_cond_t job_done;  // Сигнал писателю: задание готово
+    pthread_t *workers;       // Рабочие потоки
+    int worker_count;         // Число запущенных рабочих потоков
+    pthread_t writer_thread;  // Поток-писатель
+    uint8_t *src;             // Буфер исходного блока (без рабочих потоков)
+    uint8_t *dst;             // Буфер закодированного блока (без рабочих потоков)
+    codec_scratch_t *scratch; // Рабочая память кодировщика (без рабочих потоков)
+} pack_pipeline_t;
+
+// Элемент листинга директории при обходе дерева
+typedef struct {
+    char *name;             // Имя внутри директории
+    ino_t inode;            // Номер inode из readdir
+    unsigned char type;     // Тип из d_type (DT_UNKNOWN, если файловая система его не сообщает)
+} walk_entry_t;
+
+// Данные записи CHUNKED_FILE_ENTRY (или закодированного буфера) в памяти, проверенные по границам
+typedef struct {
+    uint64_t original_size; // Размер восстановленных данных
+    uint32_t chunk_size;    // Размер блока
+    uint32_t chunk_count;   // Число блоков
+    const uint8_t *table;   // Таблица блоков (по CHUNK_INFO_SIZE байт)
+    const uint8_t *data;    // Данные первого блока
+    int all_stored;         // Все блоки без сжатия: данные — непрерывная копия исходных
+} chunked_view_t;
+
+// Блок записи, которую собирает потоковый писатель
+typedef struct {
+    chunk_info_t info;      // Размеры, кодек и хеш блока
+    size_t staged;          // Смещение закодированного блока в staging (SIZE_MAX — берется из исходного буфера)
+} staged_chunk_t;
+
+// Потоковый писатель: записи кодируются и выводятся в поток stdio поверх памяти
+// (open_memstream) или функции записи вызывающего, каталог пишет archive_writer_t
+struct sa_writer {
+    archive_writer_t archive; // Поток архива и каталог записанных записей
+    sa_options_t options;     // Параметры писателя (хеширование содержимого включено всегда)
+    char *memory;             // Архив в памяти (только для sa_writer_open_memory)
+    size_t memory_size;       // Размер архива в памяти
+    sa_write_fn write;        // Функция записи (только для sa_writer_open_callback)
+    void *context;            // Аргумент функции записи
+    uint64_t position;        // Сколько байтов передано функции записи
+    char *stream_buffer;      // Буфер потока stdio
+    codec_scratch_t scratch;  // Рабочая память кодировщика
+    uint8_t *dst;             // Закодированный блок записи из функции чтения (CHUNK_SIZE байт)
+    uint8_t *staging;         // Закодированные блоки буферной записи или исходный блок записи из функции чтения
+    size_t staging_capacity;  // Выделено байтов под staging
+    staged_chunk_t *chunks;   // Таблица блоков текущей записи
+    uint64_t *hashes;         // Хеши блоков текущей записи (для хеша файла)
+    size_t chunk_capacity;    // Выделено места под таблицу блоков
+    int failed;               // Ошибка вывода: архив неполон, новые записи не принимаются
+};
+
+// Положение данных выданной записи: заполняется в sa_reader_next, по номеру строки каталога
+// в sa_entry_t.cursor его находят функции чтения данных
+typedef struct {
+    uint64_t offset;        // Смещение записи с данными в архиве (для копии — первой копии, для файла блока — блока)
+    uint64_t member_offset; // Смещение файла внутри сплошного блока
+    uint8_t issued;         // Запись выдана читателем
+    uint8_t member;         // Файл лежит в сплошном блоке
+} reader_location_t;
+
+// Читатель архива в памяти: записи выдаются по центральному каталогу, данные — прямо из архива
+struct sa_reader {
+    const uint8_t *data;      // Архив
+    uint64_t size;            // Размер архива
+    uint64_t mapped_size;     // Размер отображения файла (0 — память принадлежит вызывающему)
+    archive_index_t index;    // Каталог архива
+    size_t next;              // Следующая запись каталога
+    reader_location_t *locations; // Положение данных выданных записей, по строке каталога
+    uint64_t block_offset;    // Смещение текущего сплошного блока (UINT64_MAX — нет)
+    uint64_t member_offset;   // Смещение следующего файла внутри текущего сплошного блока
+    uint64_t decoded_block;   // Смещение сплошного блока, декодированного в block (UINT64_MAX — нет)
+    uint8_t *block;           // Декодированный сплошной блок
+    size_t block_capacity;    // Выделено байтов под block
+    uint8_t *buffer;          // Декодированный файл или блок файла
+    size_t buffer_capacity;   // Выделено байтов под buffer
+};
+
+// Прототипы функций
+static size_t rle_decode_pairs(const uint8_t *src, size_t n, size_t *consumed, uint8_t *dst, size_t cap); // Декодирование блока пар RLE
+static int rle_decode_buffer(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_size); // Декодирование буфера RLE
+static int rle_decode_file(FILE *in, FILE *out, uint64_t in_size, size_t buffer_size); // Декодирование файла с помощью RLE
+static FILE *open_archive(const char *path, const char *mode, size_t buffer_size, char **buffer); // Открытие архива с большим буфером
+static size_t write_entry_header(archive_writer_t *writer, uint8_t entry_type, const char *relative_path, int64_t mtime); // Запись заголовка записи
+static void write_central_directory(archive_writer_t *writer); // Запись центрального каталога и завершающего блока
+static void free_index(archive_index_t *index);            // Освобождение центрального каталога
+static int read_index(FILE *archive, archive_index_t *index); // Чтение каталога архива (или построение его обходом)
+static int unpack_entry(FILE *archive, const char *output_folder, int originals_restored, const sa_options_t *options); // Восстановление одной записи архива
+static int packbits_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_size); // Декодирование PackBits
+static int lz_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_size); // Декодирование LZ77
+static uint8_t select_codec(const uint8_t *src, size_t n, codec_scratch_t *scratch); // Выбор кодека блока по образцам данных
+static const uint8_t *map_file(int fd, uint64_t size);     // Отображение файла в память только для чтения
+static void unmap_file(const uint8_t *data, uint64_t size); // Снятие отображения файла
+static int64_t copy_range(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint64_t len, size_t buffer_size); // Копирование внутри ядра
+static void load_chunk_info(const uint8_t *p, chunk_info_t *info); // Чтение описания блока из таблицы в памяти
+static pack_file_t *pack_file_open(int dir_fd, const char *name, const char *relative_path, const struct stat *known); // Открытие файла для поблочной упаковки
+static void pack_file_begin(archive_writer_t *writer, pack_file_t *file); // Запись заголовка файла с таблицей блоков
+static void pack_file_chunk(archive_writer_t *writer, pack_file_t *file, uint32_t index, const uint8_t *data, const chunk_info_t *info); // Запись блока
+static void pack_file_end(archive_writer_t *writer, pack_file_t *file); // Запись таблицы блоков и закрытие файла
+static int unpack_chunked_file(FILE *archive, FILE *out, size_t buffer_size); // Распаковка записи CHUNKED_FILE_ENTRY
+static int ensure_buffer(uint8_t **buffer, size_t *capacity, size_t size); // Увеличение буфера до нужного размера
+static void write_file_entry(archive_writer_t *writer, pack_file_t *file, uint8_t *src, uint8_t *dst, codec_scratch_t *scratch); // Запись файла в архив
+static int pack_pipeline_start(pack_pipeline_t *pipeline, archive_writer_t *writer, int threads); // Запуск потоков упаковки
+static void pack_pipeline_submit_directory(pack_pipeline_t *pipeline, const char *relative_path, int64_t mtime); // Постановка директории в очередь
+static void pack_pipeline_submit_file(pack_pipeline_t *pipeline, pack_file_t *file); // Постановка файла в очередь
+static void pack_pipeline_finish(pack_pipeline_t *pipeline); // Завершение конвейера упаковки
+static void walk_tree(pack_pipeline_t *pipeline, const char *base_path, const char *root_name); // Итеративный обход дерева
+static int unpack_parallel(FILE *archive, const char *archive_path, const char *output_folder, const sa_options_t *options); // Параллельная разархивация
+
+// Функция для создания директории, если она не существует
+int sa_internal_create_directory(const char *path) {
+    // Пытаемся создать директорию с правами доступа 0755
+    if (mkdir(path, 0755) == 0 || (errno == EEXIST && access(path, F_OK) == 0)) {
+        return 0; // Директория успешно создана или уже существует
+    }
+    perror("mkdir"); // Выводим сообщение об ошибке, если не удалось создать директорию
+    return -1; // Возвращаем код ошибки
+}
+
+// Скалярное ядро поиска серии: сравнивает по 8 байт за раз, остаток — побайтно
+static size_t rle_match_scalar(const uint8_t *p, size_t n, uint8_t value) {
+    uint64_t pattern = 0x0101010101010101ULL * value; // Байт value, размноженный на все слово
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word)); // Невыровненное чтение слова
+        if (word != pattern) break;         // Серия обрывается внутри этого слова
+    }
+    while (i < n && p[i] == value) i++; // Досчитываем хвост серии побайтно
+    return i;
+}
+
+// Скалярное ядро декодирования: серии восстанавливаются через memset
+static size_t rle_decode_scalar(const uint8_t *src, size_t n, size_t *consumed, uint8_t *dst, size_t cap) {
+    size_t i = 0, out = 0;
+    // Декодируем пары, пока во входе есть целая пара и в выходе помещается самая длинная серия
+    while (i + 2 <= n && out + RLE_MAX_RUN <= cap) {
+        memset(dst + out, src[i + 1], src[i]);
+        out += src[i];
+        i += 2;
+    }
+    *consumed = i;
+    return out;
+}
+
+#ifdef RLE_HAVE_X86
+// Ядро SSE2: сравнивает по 16 байт и находит первый несовпавший байт по маске
+__attribute__((target("sse2")))
+static size_t rle_match_sse2(const uint8_t *p, size_t n, uint8_t value) {
+    __m128i v = _mm_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, v)) ^ 0xFFFFu;
+        if (mask) return i + __builtin_ctz(mask); // Позиция первого отличающегося байта
+    }
+    return i + rle_match_scalar(p + i, n - i, value);
+}
+
+// Ядро SSE2 для декодера: короткие серии пишутся двумя 16-байтовыми записями
+__attribute__((target("sse2")))
+static size_t rle_decode_sse2(const uint8_t *src, size_t n, size_t *consumed, uint8_t *dst, size_t cap) {
+    size_t i = 0, out = 0;
+    while (i + 2 <= n && out + RLE_MAX_RUN <= cap) {
+        unsigned count = src[i];
+        if (count <= 32) { // Пишем 32 байта с перехлестом, лишнее перезапишет следующая серия
+            __m128i v = _mm_set1_epi8((char)src[i + 1]);
+            _mm_storeu_si128((__m128i *)(dst + out), v);
+            _mm_storeu_si128((__m128i *)(dst + out + 16), v);
+        } else {
+            memset(dst + out, src[i + 1], count);
+        }
+        out += count;
+        i += 2;
+    }
+    *consumed = i;
+    return out;
+}
+
+// Ядро AVX2: сравнивает по 32 байта за итерацию.
+// Хвост досчитывается здесь же 16-байтовыми командами в кодировке VEX: вызов ядра SSE2
+// с неочищенными старшими половинами регистров стоит перехода AVX/SSE на каждой серии.
+__attribute__((target("avx2")))
+static size_t rle_match_avx2(const uint8_t *p, size_t n, uint8_t value) {
+    __m256i v = _mm256_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(p + i));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, v));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    if (i + 16 <= n) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(v))) ^ 0xFFFFu;
+        if (mask) return i + __builtin_ctz(mask);
+        i += 16;
+    }
+    return i + rle_match_scalar(p + i, n - i, value);
+}
+
+// Ядро AVX2 для декодера: короткие серии пишутся одной 32-байтовой записью
+__attribute__((target("avx2")))
+static size_t rle_decode_avx2(const uint8_t *src, size_t n, size_t *consumed, uint8_t *dst, size_t cap) {
+    size_t i = 0, out = 0;
+    while (i + 2 <= n && out + RLE_MAX_RUN <= cap) {
+        unsigned count = src[i];
+        if (count <= 32) {
+            _mm256_storeu_si256((__m256i *)(dst + out), _mm256_set1_epi8((char)src[i + 1]));
+        } else {
+            memset(dst + out, src[i + 1], count);
+        }
+        out += count;
+        i += 2;
+    }
+    *consumed = i;
+    return out;
+}
+#endif
+
+rle_match_fn sa_internal_rle_match_run = rle_match_scalar;      // Выбранное ядро поиска серии
+static rle_decode_fn rle_decode_kernel = rle_decode_scalar; // Выбранное ядро декодирования
+static pthread_once_t rle_kernels_once = PTHREAD_ONCE_INIT; // Флаг однократного выбора ядер
+
+// Выбор лучших ядер, поддерживаемых процессором
+static void rle_select_kernels(void) {
+#ifdef RLE_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        sa_internal_rle_match_run = rle_match_avx2;
+        rle_decode_kernel = rle_decode_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        sa_internal_rle_match_run = rle_match_sse2;
+        rle_decode_kernel = rle_decode_sse2;
+    }
+#endif
+}
+
+// Функция для выбора векторных ядер RLE (безопасна при повторных вызовах)
+void sa_internal_rle_init_kernels(void) {
+    pthread_once(&rle_kernels_once, rle_select_kernels);
+}
+
+// Функция для декодирования блока пар RLE.
+// Декодирует целые пары, пока в dst остается место под самую длинную серию;
+// в *consumed возвращает число прочитанных байтов src. Широкие записи коротких серий не выходят за cap.
+static size_t rle_decode_pairs(const uint8_t *src, size_t n, size_t *consumed, uint8_t *dst, size_t cap) {
+    return rle_decode_kernel(src, n, consumed, dst, cap);
+}
+
+// Функция для декодирования буфера пар RLE ровно в dst_size байт.
+// Возвращает -1, если данные повреждены или их длина не совпадает с ожидаемой.
+static int rle_decode_buffer(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_size) {
+    size_t consumed;
+    // Основную часть декодирует векторное ядро, пока в dst хватает места на самую длинную серию
+    size_t out = rle_decode_pairs(src, n, &consumed, dst, dst_size);
+    // Хвост декодируем с проверкой границ каждой серии
+    for (size_t i = consumed; i + 2 <= n; i += 2) {
+        if (src[i] > dst_size - out) return -1; // Серия выходит за пределы буфера
+        memset(dst + out, src[i + 1], src[i]);
+        out += src[i];
+    }
+    return (n % 2 == 0 && out == dst_size) ? 0 : -1;
+}
+
+// Функция для декодирования файла, закодированного с помощью RLE.
+// Читает из in ровно in_size байтов сжатых данных, поэтому может декодировать
+// запись прямо из потока архива, не выходя за ее границы.
+static int rle_decode_file(FILE *in, FILE *out, uint64_t in_size, size_t buffer_size) {
+    sa_internal_rle_init_kernels();
+
+    uint8_t *in_buf = malloc(buffer_size + 1); // Блок пар плюс байт, оставшийся от прошлого блока
+    uint8_t *out_buf = malloc(buffer_size);    // Блок восстановленных данных
+    if (!in_buf || !out_buf) {
+        perror("malloc");
+        free(in_buf);
+        free(out_buf);
+        return -1;
+    }
+
+    uint64_t remaining = in_size; // Сколько сжатых байтов записи еще не прочитано
+    size_t have = 0;              // Количество байтов во входном буфере
+    while (remaining > 0) {
+        size_t to_read = remaining > buffer_size ? buffer_size : (size_t)remaining;
+        size_t bytes = fread(in_buf + have, 1, to_read, in);
+        if (bytes == 0) break; // Архив оборвался раньше конца записи
+        remaining -= bytes;
+        have += bytes;
+        size_t pos = 0;
+        // Декодируем все целые пары блока, сбрасывая выходной буфер по мере заполнения
+        while (have - pos >= 2) {
+            size_t consumed;
+            size_t produced = rle_decode_pairs(in_buf + pos, have - pos, &consumed, out_buf, buffer_size);
+            fwrite(out_buf, 1, produced, out);
+            pos += consumed;
+        }
+        // Непарный байт-счетчик переносим в начало буфера до следующего чтения
+        if (pos < have) in_buf[0] = in_buf[pos];
+        have -= pos;
+    }
+
+    free(in_buf);
+    free(out_buf);
+
+    if (remaining > 0) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+    if (ferror(out)) {
+        perror("fwrite"); // Ошибка записи восстановленного файла
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для кодирования буфера в формате PackBits.
+// Управляющий байт c < 128 означает c + 1 литералов следом, c >= 128 — повтор следующего
+// байта c - 125 раз (3..130). Несжимаемые данные растут лишь на байт на 128 байт.
+// Возвращает 0, если результат не помещается в cap байт.
+size_t sa_internal_packbits_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    size_t out = 0, i = 0, literal_start = 0;
+
+    while (i < n) {
+        size_t run = 1;
+        // Векторное ядро вызываем только там, где начинается серия хотя бы из трех байт
+        if (i + 2 < n && src[i] == src[i + 1] && src[i] == src[i + 2]) {
+            size_t limit = n - i < PACKBITS_MAX_RUN ? n - i : PACKBITS_MAX_RUN;
+            run = 3 + sa_internal_rle_match_run(src + i + 3, limit - 3, src[i]);
+        }
+        // Группу литералов закрываем перед серией или когда она достигла предела
+        if (i > literal_start && (run >= PACKBITS_MIN_RUN || i - literal_start == PACKBITS_MAX_LITERAL)) {
+            size_t count = i - literal_start;
+            if (out + count + 1 > cap) return 0;
+            dst[out++] = (uint8_t)(count - 1);
+            memcpy(dst + out, src + literal_start, count);
+            out += count;
+            literal_start = i;
+        }
+        if (run >= PACKBITS_MIN_RUN) {
+            if (out + 2 > cap) return 0;
+            dst[out++] = (uint8_t)(run + 125);
+            dst[out++] = src[i];
+            i += run;
+            literal_start = i;
+        } else {
+            i++;
+        }
+    }
+    if (i > literal_start) { // Последняя группа литералов
+        size_t count = i - literal_start;
+        if (out + count + 1 > cap) return 0;
+        dst[out++] = (uint8_t)(count - 1);
+        memcpy(dst + out, src + literal_start, count);
+        out += count;
+    }
+    return out;
+}
+
+// Функция для декодирования PackBits ровно в dst_size байт; -1, если данные повреждены
+static int packbits_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_size) {
+    size_t i = 0, out = 0;
+    while (i < n) {
+        unsigned control = src[i++];
+        if (control < 128) { // Группа литералов
+            size_t count = control + 1;
+            if (count > n - i || count > dst_size - out) return -1;
+            memcpy(dst + out, src + i, count);
+            i += count;
+            out += count;
+        } else { // Серия одинаковых байтов
+            size_t count = control - 125;
+            if (i >= n || count > dst_size - out) return -1;
+            memset(dst + out, src[i++], count);
+            out += count;
+        }
+    }
+    return out == dst_size ? 0 : -1;
+}
+
+// Функция для чтения 32-битного слова без требований к выравниванию
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Функция для чтения 64-битного слова без требований к выравниванию
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Функция для подсчета длины общего префикса a и b (не больше limit байт)
+static inline size_t lz_common_length(const uint8_t *a, const uint8_t *b, size_t limit) {
+    size_t length = 0;
+    // Сравниваем по 8 байт, несовпавший байт находим по младшему ненулевому биту разности
+    while (length + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a + length, sizeof(x));
+        memcpy(&y, b + length, sizeof(y));
+        if (x != y) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return length + (__builtin_ctzll(x ^ y) >> 3);
+#else
+            break;
+#endif
+        }
+        length += 8;
+    }
+    while (length < limit && a[length] == b[length]) length++;
+    return length;
+}
+
+// Функция для записи длины, не поместившейся в 4 бита токена, байтами по 255
+static inline size_t lz_write_length(uint8_t *dst, size_t length) {
+    size_t out = 0;
+    for (; length >= 255; length -= 255) dst[out++] = 255;
+    dst[out++] = (uint8_t)length;
+    return out;
+}
+
+// Функция для записи одной последовательности LZ: токен, литералы и, если есть, совпадение.
+// Токен хранит длину литералов в старших 4 битах и длину совпадения минус LZ_MIN_MATCH в младших.
+// Возвращает 0, если последовательность не помещается в cap.
+static size_t lz_write_sequence(uint8_t *dst, size_t out, size_t cap, const uint8_t *literals,
+                                size_t literal_count, size_t offset, size_t match_length) {
+    // Худший случай длины заголовков: токен, две длины по байту на каждые 255 и смещение
+    size_t worst = 1 + literal_count + literal_count / 255 + 1 + 2 + match_length / 255 + 1;
+    if (out + worst > cap) return 0;
+
+    uint8_t *token = &dst[out++];
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    *token = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (literal_count >= 15) out += lz_write_length(dst + out, literal_count - 15);
+    memcpy(dst + out, literals, literal_count);
+    out += literal_count;
+
+    if (match_length) {
+        dst[out++] = (uint8_t)(offset & 0xFF); // Смещение хранится в порядке little-endian
+        dst[out++] = (uint8_t)(offset >> 8);
+        if (match_code >= 15) out += lz_write_length(dst + out, match_code - 15);
+    }
+    return out;
+}
+
+// Функция для кодирования буфера быстрым LZ77 (формат последовательностей в духе LZ4).
+// Совпадения ищутся жадно по хеш-таблице 4-байтовых префиксов; на несжимаемых данных
+// шаг поиска растет, поэтому кодировщик не тратит на них много времени.
+// table — хеш-таблица на 2^LZ_HASH_BITS позиций, которую предоставляет вызывающий.
+// Возвращает 0, если результат не помещается в cap байт.
+size_t sa_internal_lz_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint32_t *table) {
+    memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS); // Последняя позиция + 1 для каждого хеша (0 — пусто)
+
+    size_t out = 0, anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t sequence = load32(src + i);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)(i + 1);
+
+        if (candidate && i - (candidate - 1) <= LZ_MAX_OFFSET && load32(src + candidate - 1) == sequence) {
+            size_t match = candidate - 1;
+            size_t length = LZ_MIN_MATCH + lz_common_length(src + match + LZ_MIN_MATCH, src + i + LZ_MIN_MATCH,
+                                                            n - i - LZ_MIN_MATCH);
+            out = lz_write_sequence(dst, out, cap, src + anchor, i - anchor, i - match, length);
+            if (out == 0) return 0;
+            i += length;
+            anchor = i;
+        } else {
+            i += 1 + ((i - anchor) >> 6); // Ускоряемся, пока совпадений нет
+        }
+    }
+
+    // Последняя последовательность состоит только из литералов
+    if (anchor < n || out == 0) {
+        out = lz_write_sequence(dst, out, cap, src + anchor, n - anchor, 0, 0);
+    }
+    return out;
+}
+
+// Функция для копирования 8-байтовыми словами: пишет до 7 байт за концом [dst, dst + n),
+// поэтому вызывается только при запасе LZ_WILDCOPY_SLACK байт в приемнике.
+// Источник должен отставать от приемника хотя бы на 8 байт.
+static inline void lz_wildcopy8(uint8_t *dst, const uint8_t *src, size_t n) {
+    uint8_t *end = dst + n;
+    do {
+        memcpy(dst, src, 8);
+        dst += 8;
+        src += 8;
+    } while (dst < end);
+}
+
+// Функция для копирования 16-байтовыми словами (запас и отставание — 16 байт)
+static inline void lz_wildcopy16(uint8_t *dst, const uint8_t *src, size_t n) {
+    uint8_t *end = dst + n;
+    do {
+        memcpy(dst, src, 16);
+        dst += 16;
+        src += 16;
+    } while (dst < end);
+}
+
+// Функция для чтения продолжения длины: байты по 255 и завершающий байт меньше 255
+static inline int lz_read_length(const uint8_t **ip, const uint8_t *ip_end, size_t *length) {
+    unsigned byte;
+    do {
+        if (*ip >= ip_end) return -1;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+// Функция для копирования совпадения. Вдали от конца приемника копирует широкими словами:
+// серия одного байта — memset, короткий период разворачивается в шаблон, длина которого
+// кратна периоду и не меньше 8 байт. У конца приемника копирует точно.
+static inline void lz_copy_match(uint8_t *op, size_t offset, size_t length, const uint8_t *op_end) {
+    const uint8_t *match = op - offset;
+    if ((size_t)(op_end - op) >= length + LZ_WILDCOPY_SLACK) {
+        if (offset >= 16) {
+            lz_wildcopy16(op, match, length);
+        } else if (offset >= 8) {
+            lz_wildcopy8(op, match, length);
+        } else if (offset == 1) {
+            memset(op, match[0], length);
+        } else { // Период 2..7: первые 8 байт побайтно, дальше шаблон повторяется с шагом, кратным периоду
+            for (size_t k = 0; k < 8; k++) op[k] = match[k];
+            size_t period = offset * ((8 + offset - 1) / offset);
+            if (length > 8) lz_wildcopy8(op + 8, op + 8 - period, length - 8);
+        }
+        return;
+    }
+
+    if (offset >= length) { // Источник и приемник не пересекаются
+        memcpy(op, match, length);
+    } else { // Пересекаются: копируем побайтно
+        for (size_t k = 0; k < length; k++) op[k] = match[k];
+    }
+}
+
+// Функция для декодирования LZ77 ровно в dst_size байт; -1, если данные повреждены.
+// Короткие литералы и совпадения копируются словами с перекрытием за конец, пока
+// до конца источника и приемника есть запас; у конца блока копирование точное.
+static int lz_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_size) {
+    const uint8_t *ip = src, *ip_end = src + n;
+    uint8_t *op = dst, *op_end = dst + dst_size;
+
+    while (ip < ip_end) {
+        unsigned token = *ip++;
+
+        // Частый случай вдали от концов: короткие литералы и короткое совпадение с периодом от 8 байт
+        // копируются словами фиксированной длины без циклов
+        size_t literal_count = token >> 4;
+        if (literal_count < 15 && (token & 15) < 15 && ip_end - ip >= 32 && op_end - op >= 32) {
+            memcpy(op, ip, 16);
+            ip += literal_count;
+            op += literal_count;
+            size_t offset = ip[0] | ((size_t)ip[1] << 8);
+            size_t length = (token & 15) + LZ_MIN_MATCH;
+            if (offset >= 8 && offset <= (size_t)(op - dst)) {
+                ip += 2;
+                memcpy(op, op - offset, 8);
+                memcpy(op + 8, op + 8 - offset, 8);
+                memcpy(op + 16, op + 16 - offset, 2);
+                op += length;
+                continue;
+            }
+            // Короткий период или поврежденное смещение — общим путем ниже
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - dst) || length > (size_t)(op_end - op)) return -1;
+            lz_copy_match(op, offset, length, op_end);
+            op += length;
+            continue;
+        }
+
+        // Литералы
+        if (literal_count == 15 && lz_read_length(&ip, ip_end, &literal_count) != 0) return -1;
+        if (literal_count > (size_t)(ip_end - ip) || literal_count > (size_t)(op_end - op)) return -1;
+        if (literal_count <= 16 && ip_end - ip >= 16 && op_end - op >= 16) {
+            memcpy(op, ip, 16); // Короткие литералы — одним словом
+        } else {
+            memcpy(op, ip, literal_count);
+        }
+        ip += literal_count;
+        op += literal_count;
+        if (ip == ip_end) break; // Последняя последовательность без совпадения
+
+        // Совпадение
+        if (ip_end - ip < 2) return -1;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t length = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15 && lz_read_length(&ip, ip_end, &length) != 0) return -1;
+        if (offset == 0 || offset > (size_t)(op - dst) || length > (size_t)(op_end - op)) return -1;
+
+        lz_copy_match(op, offset, length, op_end);
+        op += length;
+    }
+    return op == op_end ? 0 : -1;
+}
+
+// Функция для выбора кодека блока. Пробно кодирует несколько равномерно
+// распределенных образцов по 4 КБ каждым кодеком и выбирает давший меньший размер
+// с поправкой на скорость декодирования; если ни один не сжимает образцы хотя бы на 3%,
+// блок хранится как есть.
+static uint8_t select_codec(const uint8_t *src, size_t n, codec_scratch_t *scratch) {
+    if (n == 0) return CODEC_STORED;
+
+    size_t sampled = 0, packbits_size = 0, lz_size = 0;
+    size_t samples = CODEC_SAMPLE_COUNT, stride = (n - CODEC_SAMPLE_SIZE) / (CODEC_SAMPLE_COUNT - 1);
+    if (n <= CODEC_SAMPLE_SIZE * CODEC_SAMPLE_COUNT) { // Небольшой блок пробуем целиком
+        samples = (n + CODEC_SAMPLE_SIZE - 1) / CODEC_SAMPLE_SIZE;
+        stride = CODEC_SAMPLE_SIZE;
+    }
+
+    for (size_t k = 0; k < samples; k++) {
+        size_t offset = k * stride;
+        size_t length = n - offset < CODEC_SAMPLE_SIZE ? n - offset : CODEC_SAMPLE_SIZE;
+        size_t encoded;
+        // Образец, который кодек не смог ужать, считаем хранимым как есть
+        encoded = sa_internal_packbits_encode(src + offset, length, scratch->sample, length);
+        packbits_size += encoded ? encoded : length;
+        encoded = sa_internal_lz_encode(src + offset, length, scratch->sample, length, scratch->lz_table);
+        lz_size += encoded ? encoded : length;
+        sampled += length;
+    }
+
+    size_t best = packbits_size < lz_size ? packbits_size : lz_size;
+    if (best * 100 > sampled * 97) return CODEC_STORED; // Сжатие не окупит декодирование
+
+    // PackBits декодируется в разы быстрее LZ, поэтому блок из серий остается за ним,
+    // если LZ не экономит хотя бы LZ_MIN_GAIN процентов исходного размера сверх PackBits
+    if (packbits_size * 100 <= sampled * 97 && packbits_size <= lz_size + sampled * LZ_MIN_GAIN / 100) {
+        return CODEC_PACKBITS;
+    }
+    return CODEC_LZ;
+}
+
+
+// Функция для открытия архива с буфером stdio размера buffer_size.
+// Буфер возвращается через *buffer и освобождается вызывающим после fclose().
+static FILE *open_archive(const char *path, const char *mode, size_t buffer_size, char **buffer) {
+    FILE *archive = fopen(path, mode);
+    if (!archive) return NULL;
+
+    *buffer = malloc(buffer_size);
+    if (*buffer) {
+        setvbuf(archive, *buffer, _IOFBF, buffer_size); // Заголовки записей читаются и пишутся без лишних системных вызовов
+    }
+    return archive;
+}
+
+// Функция для добавления записи в центральный каталог архива, открытого на запись.
+// Возвращает номер записи в каталоге или SIZE_MAX, если не хватило памяти:
+// без записи каталог архива неполон, поэтому писатель помечается неудавшимся.
+static size_t index_add_entry(archive_writer_t *writer, uint8_t entry_type, const char *relative_path, uint64_t offset, int64_t mtime) {
+    archive_index_t *index = &writer->index;
+    if (index->count == index->capacity) { // Увеличиваем каталог вдвое
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        index_entry_t *entries = realloc(index->entries, capacity * sizeof(index_entry_t));
+        if (!entries) {
+            perror("realloc");
+            writer->failed = 1;
+            return SIZE_MAX;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    char *path = strdup(relative_path);
+    if (!path) {
+        perror("strdup");
+        writer->failed = 1;
+        return SIZE_MAX;
+    }
+
+    index_entry_t *entry = &index->entries[index->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->entry_type = entry_type;
+    entry->path = path;
+    entry->offset = offset;
+    entry->mtime = mtime;
+    return index->count++;
+}
+
+// Функция для записи заголовка записи: тип, длина пути и сам путь.
+// Запись сразу регистрируется в центральном каталоге; возвращается ее номер в каталоге
+// или SIZE_MAX, если зарегистрировать ее не удалось (заголовок все равно пишется).
+// Путь длиной PATH_MAX и больше чтение отвергает, поэтому такой заголовок не пишется вовсе,
+// а писатель помечается неудавшимся.
+static size_t write_entry_header(archive_writer_t *writer, uint8_t entry_type, const char *relative_path, int64_t mtime) {
+    if (strlen(relative_path) >= PATH_MAX) {
+        fprintf(stderr, "Ошибка: путь %s слишком длинный для архива\n", relative_path);
+        writer->failed = 1;
+        return SIZE_MAX;
+    }
+
+    // Запись начинается с текущей позиции архива
+    size_t slot = index_add_entry(writer, entry_type, relative_path, ftello(writer->file), mtime);
+    uint16_t path_length = strlen(relative_path); // Длина относительного пути
+
+    // Записываем тип записи и длину пути в архив
+    fwrite(&entry_type, sizeof(uint8_t), 1, writer->file);
+    fwrite(&path_length, sizeof(uint16_t), 1, writer->file);
+    fwrite(relative_path, sizeof(char), path_length, writer->file); // Записываем относительный путь
+    return slot;
+}
+
+// Функция для записи центрального каталога в конец архива.
+// За каталогом следует завершающий блок фиксированного размера, по которому каталог
+// находится чтением последних INDEX_TRAILER_SIZE байтов архива.
+static void write_central_directory(archive_writer_t *writer) {
+    FILE *archive = writer->file;
+    uint64_t directory_offset = ftello(archive);
+    uint64_t entry_count = writer->index.count;
+    uint32_t version = INDEX_VERSION;
+
+    for (size_t i = 0; i < writer->index.count; i++) {
+        const index_entry_t *entry = &writer->index.entries[i];
+        uint16_t path_length = strlen(entry->path);
+        fwrite(&entry->entry_type, sizeof(uint8_t), 1, archive);    // Тип записи
+        fwrite(&path_length, sizeof(uint16_t), 1, archive);         // Длина пути
+        fwrite(entry->path, sizeof(char), path_length, archive);    // Путь
+        fwrite(&entry->offset, sizeof(uint64_t), 1, archive);       // Смещение записи
+        fwrite(&entry->original_size, sizeof(uint64_t), 1, archive); // Исходный размер
+        fwrite(&entry->stored_size, sizeof(uint64_t), 1, archive);  // Размер в архиве
+        fwrite(&entry->mtime, sizeof(int64_t), 1, archive);         // Время изменения
+        fwrite(&entry->hash, sizeof(uint64_t), 1, archive);         // Хеш содержимого
+    }
+
+    // Завершающий блок: где начинается каталог и сколько в нем записей
+    fwrite(&directory_offset, sizeof(uint64_t), 1, archive);
+    fwrite(&entry_count, sizeof(uint64_t), 1, archive);
+    fwrite(&version, sizeof(uint32_t), 1, archive);
+    fwrite(INDEX_MAGIC, sizeof(char), 4, archive);
+}
+
+// Функция одного шага перемешивания хеша
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+    acc += input * HASH_PRIME2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * HASH_PRIME1;
+}
+
+// Функция для подмешивания накопителя в итоговое значение хеша
+static inline uint64_t hash_merge(uint64_t hash, uint64_t acc) {
+    hash ^= hash_round(0, acc);
+    return hash * HASH_PRIME1 + HASH_PRIME4;
+}
+
+// Функция для вычисления 64-битного хеша данных (алгоритм XXH64).
+// Основной цикл ведет четыре независимых накопителя по 8 байт и обрабатывает 32 байта за шаг.
+uint64_t sa_internal_content_hash(const uint8_t *data, size_t n, uint64_t seed) {
+    const uint8_t *p = data, *end = data + n;
+    uint64_t hash;
+
+    if (n >= 32) {
+        uint64_t v1 = seed + HASH_PRIME1 + HASH_PRIME2, v2 = seed + HASH_PRIME2, v3 = seed, v4 = seed - HASH_PRIME1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = hash_round(v1, load64(p));
+            v2 = hash_round(v2, load64(p + 8));
+            v3 = hash_round(v3, load64(p + 16));
+            v4 = hash_round(v4, load64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        hash = ((v1 << 1) | (v1 >> 63)) + ((v2 << 7) | (v2 >> 57)) + ((v3 << 12) | (v3 >> 52)) + ((v4 << 18) | (v4 >> 46));
+        hash = hash_merge(hash, v1);
+        hash = hash_merge(hash, v2);
+        hash = hash_merge(hash, v3);
+        hash = hash_merge(hash, v4);
+    } else {
+        hash = seed + HASH_PRIME5;
+    }
+    hash += n;
+
+    // Хвост короче 32 байт: по 8, по 4 и по одному байту
+    for (; p + 8 <= end; p += 8) {
+        hash ^= hash_round(0, load64(p));
+        hash = ((hash << 27) | (hash >> 37)) * HASH_PRIME1 + HASH_PRIME4;
+    }
+    if (p + 4 <= end) {
+        hash ^= (uint64_t)load32(p) * HASH_PRIME1;
+        hash = ((hash << 23) | (hash >> 41)) * HASH_PRIME2 + HASH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * HASH_PRIME5;
+        hash = ((hash << 11) | (hash >> 53)) * HASH_PRIME1;
+    }
+
+    // Финальное перемешивание битов
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Функция для получения хеша файла из хешей его блоков по CHUNK_SIZE байт.
+// Блоки хешируются независимо (в рабочих потоках), а хеш файла — это хеш массива их хешей.
+// Значение 0 зарезервировано за «хеш неизвестен».
+static uint64_t combine_chunk_hashes(const uint64_t *hashes, uint32_t count, uint64_t size) {
+    uint64_t hash = sa_internal_content_hash((const uint8_t *)hashes, (size_t)count * sizeof(uint64_t), size);
+    return hash ? hash : 1;
+}
+
+// Функция для кодирования одного блока файла кодеком, выбранным по его содержимому.
+// В dst должно помещаться n байт; кодек и размеры блока записываются в info.
+// Память не выделяется: кодировщик работает в scratch, который передает вызывающий.
+// Возвращает 0, если блок хранится без сжатия: его данные в dst не копируются,
+// и вызывающий сам решает, откуда их взять.
+size_t sa_internal_encode_chunk(const uint8_t *src, size_t n, uint8_t *dst, chunk_info_t *info, codec_scratch_t *scratch) {
+    size_t encoded = 0;
+    info->codec = select_codec(src, n, scratch);
+    info->original_size = (uint32_t)n;
+
+    // Результат не больше исходного блока, иначе блок хранится как есть
+    if (info->codec == CODEC_PACKBITS) {
+        encoded = sa_internal_packbits_encode(src, n, dst, n);
+    } else if (info->codec == CODEC_LZ) {
+        encoded = sa_internal_lz_encode(src, n, dst, n, scratch->lz_table);
+    }
+    if (encoded == 0) {
+        info->codec = CODEC_STORED;
+        info->stored_size = (uint32_t)n;
+        return 0;
+    }
+    info->stored_size = (uint32_t)encoded;
+    return encoded;
+}
+
+// Функция для декодирования одного блока файла в dst (info->original_size байт)
+int sa_internal_decode_chunk(const chunk_info_t *info, const uint8_t *src, uint8_t *dst) {
+    switch (info->codec) {
+        case CODEC_STORED:
+            if (info->stored_size != info->original_size) return -1;
+            memcpy(dst, src, info->stored_size);
+            return 0;
+        case CODEC_RLE: // Блоки прежнего формата
+            return rle_decode_buffer(src, info->stored_size, dst, info->original_size);
+        case CODEC_PACKBITS:
+            return packbits_decode(src, info->stored_size, dst, info->original_size);
+        case CODEC_LZ:
+            return lz_decode(src, info->stored_size, dst, info->original_size);
+        default:
+            fprintf(stderr, "Ошибка: неизвестный кодек блока %u\n", info->codec);
+            return -1;
+    }
+}
+
+// Функция для чтения блока файла по смещению; возвращает число прочитанных байтов
+size_t sa_internal_read_chunk(int fd, uint8_t *buf, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t bytes = pread(fd, buf + total, len - total, offset + total);
+        if (bytes < 0 && errno == EINTR) continue; // Чтение прервано сигналом, повторяем
+        if (bytes < 0) perror("pread");
+        if (bytes <= 0) break; // Ошибка или файл стал короче, чем при обходе
+        total += bytes;
+    }
+    return total;
+}
+
+// Функция для записи буфера в файл по смещению
+int sa_internal_write_at(int fd, const uint8_t *buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t bytes = pwrite(fd, buf, len, (off_t)offset);
+        if (bytes < 0 && errno == EINTR) continue; // Запись прервана сигналом, повторяем
+        if (bytes <= 0) {
+            perror("pwrite");
+            return -1;
+        }
+        buf += bytes;
+        len -= bytes;
+        offset += bytes;
+    }
+    return 0;
+}
+
+// Функция для отображения файла в память только для чтения.
+// Возвращает NULL для небольших файлов и там, где mmap недоступен, — тогда файл читается через pread.
+static const uint8_t *map_file(int fd, uint64_t size) {
+    if (size < MMAP_MIN_SIZE || size > SIZE_MAX) return NULL;
+    void *data = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return NULL; // Например, файловая система без поддержки mmap
+    return data;
+}
+
+// Функция для снятия отображения, созданного map_file
+static void unmap_file(const uint8_t *data, uint64_t size) {
+    if (data) munmap((void *)data, (size_t)size);
+}
+
+// Функция для копирования len байтов между файлами по смещениям так, чтобы данные не проходили
+// через память процесса. Сначала пробуется copy_file_range, затем sendfile, а если ядро или
+// файловые системы их не поддерживают (например, файлы на разных файловых системах в старых ядрах),
+// данные копируются обычным чтением и записью через буфер buffer_size байт. Возвращает число скопированных байтов —
+// меньше len, если исходный файл кончился раньше, — или -1 при ошибке.
+static int64_t copy_range(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint64_t len, size_t buffer_size) {
+    uint64_t total = 0;
+#ifdef __linux__
+    while (total < len) {
+        loff_t in_off = (loff_t)(in_offset + total), out_off = (loff_t)(out_offset + total);
+        ssize_t bytes = copy_file_range(in_fd, &in_off, out_fd, &out_off, len - total, 0);
+        if (bytes < 0 && errno == EINTR) continue; // Копирование прервано сигналом, повторяем
+        if (bytes < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) break;
+        if (bytes < 0) {
+            perror("copy_file_range");
+            return -1;
+        }
+        if (bytes == 0) return (int64_t)total; // Исходный файл кончился
+        total += bytes;
+    }
+
+    // sendfile пишет с текущей позиции выходного дескриптора, поэтому сначала переходим к смещению
+    if (total < len && lseek(out_fd, (off_t)(out_offset + total), SEEK_SET) >= 0) {
+        while (total < len) {
+            off_t in_off = (off_t)(in_offset + total);
+            ssize_t bytes = sendfile(out_fd, in_fd, &in_off, len - total);
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes < 0 && (errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) break;
+            if (bytes < 0) {
+                perror("sendfile");
+                return -1;
+            }
+            if (bytes == 0) return (int64_t)total;
+            total += bytes;
+        }
+    }
+#endif
+    if (total == len) return (int64_t)total;
+
+    // Копирование внутри ядра недоступно: переносим данные через буфер
+    uint8_t *buffer = malloc(buffer_size);
+    if (!buffer) {
+        perror("malloc");
+        return -1;
+    }
+    while (total < len) {
+        size_t want = len - total < buffer_size ? (size_t)(len - total) : buffer_size;
+        size_t bytes = sa_internal_read_chunk(in_fd, buffer, want, (off_t)(in_offset + total));
+        if (bytes > 0 && sa_internal_write_at(out_fd, buffer, bytes, out_offset + total) != 0) {
+            free(buffer);
+            return -1;
+        }
+        total += bytes;
+        if (bytes < want) break; // Исходный файл кончился
+    }
+    free(buffer);
+    return (int64_t)total;
+}
+
+// Функция для открытия файла перед поблочной упаковкой.
+// Файл открывается относительно дескриптора директории, а размер и время изменения берутся
+// из known, если обход уже сделал fstatat элемента, иначе fstat открытого дескриптора, —
+// так у файла за всю упаковку ровно один stat. Если файл подменили между fstatat и открытием,
+// чтение окажется коротким, и упаковка завершится ошибкой.
+// Число блоков фиксируется по размеру на момент обхода: дописанное позже в архив не попадет.
+static pack_file_t *pack_file_open(int dir_fd, const char *name, const char *relative_path, const struct stat *known) {
+    // O_NONBLOCK не дает зависнуть на FIFO, подмененном вместо файла после readdir
+    int fd = openat(dir_fd, name, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        perror("openat"); // Выводим сообщение об ошибке, если не удалось открыть файл
+        return NULL;
+    }
+
+    struct stat path_stat;
+    if (known) {
+        path_stat = *known;
+    } else if (fstat(fd, &path_stat) != 0) {
+        perror("fstat");
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(path_stat.st_mode)) { // Не обычный файл в архив не попадает
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t size = path_stat.st_size;
+    pack_file_t *file = calloc(1, sizeof(pack_file_t));
+    uint32_t chunk_count = (uint32_t)((size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    chunk_info_t *chunks = calloc(chunk_count ? chunk_count : 1, sizeof(chunk_info_t));
+    char *path = strdup(relative_path);
+    if (!file || !chunks || !path) {
+        perror("calloc");
+        free(file);
+        free(chunks);
+        free(path);
+        close(fd);
+        return NULL;
+    }
+
+    file->relative_path = path;
+    file->mtime = path_stat.st_mtime;
+    file->fd = fd;
+    file->source_size = size;
+    file->chunk_count = chunk_count;
+    file->chunks = chunks;
+    // Большой файл отображается в память, и кодировщик читает блоки прямо из страничного кеша.
+    // Перед чтением блока из отображения pack_chunk_source сверяет размер файла: блок за новым
+    // концом укороченного файла читается через pread, а не обращением к страницам за концом (SIGBUS).
+    file->map = map_file(fd, size);
+    if (file->map) posix_madvise((void *)file->map, (size_t)size, POSIX_MADV_SEQUENTIAL);
+    return file;
+}
+
+// Функция для сообщения об укоротившемся во время упаковки файле: его запись в архиве неверна,
+// поэтому упаковка завершится ошибкой
+static void report_shrunk_file(const pack_file_t *file, uint32_t index) {
+    fprintf(stderr, "Ошибка: файл %s укоротился во время упаковки (блок %u)\n", file->relative_path, index);
+}
+
+// Функция для записи описания одного блока в таблицу
+static void write_chunk_info(FILE *archive, const chunk_info_t *info) {
+    fwrite(&info->original_size, sizeof(uint32_t), 1, archive); // Исходный размер блока
+    fwrite(&info->stored_size, sizeof(uint32_t), 1, archive);   // Закодированный размер блока
+    fwrite(&info->codec, sizeof(uint8_t), 1, archive);          // Кодек блока
+}
+
+// Функция для записи заголовка файла: размер, размер блока, число блоков и таблица блоков.
+// Таблица пока пустая — настоящие размеры станут известны после кодирования блоков.
+static void pack_file_begin(archive_writer_t *writer, pack_file_t *file) {
+    FILE *archive = writer->file;
+    uint32_t chunk_size = CHUNK_SIZE;
+
+    file->index_slot = write_entry_header(writer, CHUNKED_FILE_ENTRY, file->relative_path, file->mtime);
+    file->table_offset = ftello(archive); // Запоминаем место заголовка, чтобы дописать его в конце
+
+    fwrite(&file->original_size, sizeof(uint64_t), 1, archive); // Оригинальный размер файла
+    fwrite(&chunk_size, sizeof(uint32_t), 1, archive);          // Размер блока
+    fwrite(&file->chunk_count, sizeof(uint32_t), 1, archive);   // Число блоков
+    for (uint32_t i = 0; i < file->chunk_count; i++) {
+        write_chunk_info(archive, &file->chunks[i]); // Резервируем место под таблицу
+    }
+}
+
+// Функция для записи закодированного блока в архив.
+// Если data равно NULL, блок хранится без сжатия и копируется из исходного файла внутри ядра.
+static void pack_file_chunk(archive_writer_t *writer, pack_file_t *file, uint32_t index, const uint8_t *data, const chunk_info_t *info) {
+    FILE *archive = writer->file;
+    if (data || info->stored_size == 0) {
+        fwrite(data, 1, info->stored_size, archive);
+    } else {
+        fflush(archive); // Данные потока должны оказаться в файле раньше скопированного блока
+        off_t out_offset = ftello(archive);
+        int64_t copied = copy_range(file->fd, (uint64_t)index * CHUNK_SIZE, fileno(archive), out_offset, info->stored_size,
+                                    writer->options->buffer_size);
+        if (copied < 0) {
+            fprintf(stderr, "Ошибка: не удалось скопировать блок %u файла %s\n", index, file->relative_path);
+            writer->failed = 1; // Архив без этого блока неполон
+            copied = 0;
+        }
+        fseeko(archive, out_offset + copied, SEEK_SET);
+        if (copied < info->stored_size) {
+            // Файл укоротился после чтения блока: запись неверна, как и при коротком чтении
+            // в pack_chunk_source, и упаковка завершится ошибкой
+            struct stat st;
+            uint64_t chunk_end = (uint64_t)index * CHUNK_SIZE + info->stored_size;
+            if (fstat(file->fd, &st) == 0 && (uint64_t)st.st_size < chunk_end) {
+                report_shrunk_file(file, index);
+            } else if (!writer->failed) {
+                fprintf(stderr, "Ошибка: блок %u файла %s скопирован не полностью\n", index, file->relative_path);
+            }
+            writer->failed = 1;
+            for (int64_t i = copied; i < info->stored_size; i++) {
+                fputc(0, archive); // Держим смещения следующих записей согласованными с таблицей
+            }
+        }
+    }
+    file->chunks[index] = *info;
+    file->original_size += info->original_size;
+}
+
+// Функция для закрытия упаковываемого файла и освобождения его описания
+static void pack_file_close(pack_file_t *file) {
+    unmap_file(file->map, file->source_size);
+    close(file->fd);
+    free(file->relative_path);
+    free(file->chunks);
+    free(file);
+}
+
+// Функция для завершения файла: дописывает размер и таблицу блоков, закрывает и освобождает файл
+static void pack_file_end(archive_writer_t *writer, pack_file_t *file) {
+    FILE *archive = writer->file;
+    if (file->index_slot != SIZE_MAX) { // Запись есть в каталоге
+        index_entry_t *entry = &writer->index.entries[file->index_slot];
+        entry->original_size = file->original_size;
+        for (uint32_t i = 0; i < file->chunk_count; i++) {
+            entry->stored_size += file->chunks[i].stored_size; // В каталог попадает суммарный размер блоков
+        }
+        uint64_t *hashes = writer->options->content_hashing ? malloc((file->chunk_count ? file->chunk_count : 1) * sizeof(uint64_t)) : NULL;
+        if (hashes) { // Хеш файла собирается из хешей блоков, посчитанных рабочими потоками
+            for (uint32_t i = 0; i < file->chunk_count; i++) {
+                hashes[i] = file->chunks[i].hash;
+            }
+            entry->hash = combine_chunk_hashes(hashes, file->chunk_count, file->original_size);
+            free(hashes);
+        }
+    }
+
+    fseeko(archive, file->table_offset, SEEK_SET);
+    fwrite(&file->original_size, sizeof(uint64_t), 1, archive); // Фактический размер файла
+    fseeko(archive, 2 * sizeof(uint32_t), SEEK_CUR);            // Размер блока и число блоков не меняются
+    for (uint32_t i = 0; i < file->chunk_count; i++) {
+        write_chunk_info(archive, &file->chunks[i]);
+    }
+    fseeko(archive, 0, SEEK_END); // Возвращаемся в конец архива
+
+    pack_file_close(file);
+}
+
+// Функция для получения исходных данных блока: прямо из отображения файла,
+// а если файл не отображен или укоротился после обхода — чтением в буфер src (CHUNK_SIZE байт).
+// *bytes меньше len, только если файл укоротился во время упаковки.
+static const uint8_t *pack_chunk_source(pack_file_t *file, uint32_t index, size_t len, uint8_t *src, size_t *bytes) {
+    uint64_t offset = (uint64_t)index * CHUNK_SIZE;
+    struct stat st;
+    if (file->map && fstat(file->fd, &st) == 0 && (uint64_t)st.st_size >= offset + len) {
+        *bytes = len;
+        return file->map + offset;
+    }
+    *bytes = sa_internal_read_chunk(file->fd, src, len, (off_t)offset);
+    return src;
+}
+
+// Функция для записи файла в архив в вызывающем потоке: блоки кодируются по одному
+// в буферах src и dst по CHUNK_SIZE байт с рабочей памятью кодировщика scratch; файл закрывается
+static void write_file_entry(archive_writer_t *writer, pack_file_t *file, uint8_t *src, uint8_t *dst, codec_scratch_t *scratch) {
+    pack_file_begin(writer, file);
+    for (uint32_t i = 0; i < file->chunk_count; i++) {
+        uint64_t remaining = file->source_size - (uint64_t)i * CHUNK_SIZE;
+        size_t bytes;
+        size_t len = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+        const uint8_t *data = pack_chunk_source(file, i, len, src, &bytes);
+        if (bytes < len) {
+            report_shrunk_file(file, i);
+            writer->failed = 1;
+        }
+        chunk_info_t info;
+        info.hash = writer->options->content_hashing ? sa_internal_content_hash(data, bytes, 0) : 0;
+        if (sa_internal_encode_chunk(data, bytes, dst, &info, scratch) != 0) {
+            pack_file_chunk(writer, file, i, dst, &info);
+        } else {
+            // Блок без сжатия: из отображения копирует ядро, прочитанный в буфер пишем как есть
+            pack_file_chunk(writer, file, i, data == src ? data : NULL, &info);
+        }
+    }
+    pack_file_end(writer, file);
+}
+
+// Функция для чтения заголовка и таблицы блоков записи CHUNKED_FILE_ENTRY по ее смещению
+static int read_chunked_header(int fd, uint64_t entry_offset, chunked_header_t *header) {
+    uint8_t fixed[sizeof(uint64_t) + 2 * sizeof(uint32_t)];
+    uint16_t path_length;
+    memset(header, 0, sizeof(*header));
+
+    // Пропускаем тип и путь записи, затем читаем размеры
+    if (sa_internal_read_chunk(fd, (uint8_t *)&path_length, sizeof(path_length), entry_offset + 1) != sizeof(path_length)) return -1;
+    uint64_t offset = entry_offset + 1 + sizeof(uint16_t) + path_length;
+    if (sa_internal_read_chunk(fd, fixed, sizeof(fixed), offset) != sizeof(fixed)) return -1;
+    memcpy(&header->original_size, fixed, sizeof(uint64_t));
+    memcpy(&header->chunk_size, fixed + sizeof(uint64_t), sizeof(uint32_t));
+    memcpy(&header->chunk_count, fixed + sizeof(uint64_t) + sizeof(uint32_t), sizeof(uint32_t));
+    if (header->chunk_size == 0 || header->chunk_size > MAX_CHUNK_SIZE) return -1;
+    offset += sizeof(fixed);
+
+    // Таблица блоков читается одним вызовом и разбирается в памяти
+    size_t record_size = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+    size_t table_size = (size_t)header->chunk_count * record_size;
+    uint8_t *table = malloc(table_size ? table_size : 1);
+    header->chunks = malloc((header->chunk_count ? header->chunk_count : 1) * sizeof(chunk_info_t));
+    if (!table || !header->chunks || sa_internal_read_chunk(fd, table, table_size, offset) != table_size) {
+        free(table);
+        free(header->chunks);
+        header->chunks = NULL;
+        return -1;
+    }
+    for (uint32_t i = 0; i < header->chunk_count; i++) {
+        chunk_info_t *info = &header->chunks[i];
+        memcpy(&info->original_size, table + i * record_size, sizeof(uint32_t));
+        memcpy(&info->stored_size, table + i * record_size + sizeof(uint32_t), sizeof(uint32_t));
+        info->codec = table[i * record_size + 2 * sizeof(uint32_t)];
+        if (info->original_size > header->chunk_size || info->stored_size > 2 * (size_t)header->chunk_size) {
+            free(table);
+            free(header->chunks);
+            header->chunks = NULL;
+            return -1;
+        }
+    }
+    free(table);
+    header->data_offset = offset + table_size;
+    return 0;
+}
+
+// Функция для сравнения записей каталога по пути
+static int compare_entry_paths(const void *a, const void *b) {
+    return strcmp((*(index_entry_t *const *)a)->path, (*(index_entry_t *const *)b)->path);
+}
+
+// Функция для вычисления хеша содержимого открытого файла так же, как его считает упаковка.
+// Файл без отображения читается в *buffer (CHUNK_SIZE байт), который выделяется при первом вызове.
+static uint64_t hash_file(pack_file_t *file, uint8_t **buffer) {
+    if (!*buffer && !(*buffer = malloc(CHUNK_SIZE))) { // Нужен и отображенному файлу, если он укоротился
+        perror("malloc");
+        return 0;
+    }
+    uint64_t *hashes = malloc((file->chunk_count ? file->chunk_count : 1) * sizeof(uint64_t));
+    if (!hashes) {
+        perror("malloc");
+        return 0;
+    }
+
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < file->chunk_count; i++) {
+        uint64_t remaining = file->source_size - (uint64_t)i * CHUNK_SIZE;
+        size_t bytes;
+        const uint8_t *data = pack_chunk_source(file, i, remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE, *buffer, &bytes);
+        hashes[i] = sa_internal_content_hash(data, bytes, 0);
+        size += bytes;
+    }
+    uint64_t hash = combine_chunk_hashes(hashes, file->chunk_count, size);
+    free(hashes);
+    return hash;
+}
+
+// Функция для поиска строки каталога предыдущего архива по пути файла (NULL — файла там нет)
+static index_entry_t *find_previous_entry(const previous_archive_t *previous, const char *relative_path) {
+    index_entry_t key = {.path = (char *)relative_path};
+    index_entry_t *key_pointer = &key;
+    index_entry_t **found = bsearch(&key_pointer, previous->by_path, previous->count, sizeof(index_entry_t *), compare_entry_paths);
+    return found ? *found : NULL;
+}
+
+// Функция для проверки, что файл не изменился с момента записи entry в предыдущий архив.
+// Файл считается неизменившимся, если совпадают размер и время изменения. С опцией -hash решает
+// хеш содержимого: файл, у которого поменялось только время изменения, переносится, а измененный
+// с сохранением времени — кодируется. Хеш для нового каталога сохраняется в *hash.
+static int previous_entry_unchanged(previous_archive_t *previous, const index_entry_t *entry, pack_file_t *file,
+                                    int content_hashing, uint64_t *hash) {
+    if (entry->original_size != file->source_size) return 0;
+    *hash = entry->hash;
+    if (content_hashing && entry->hash != 0) {
+        return hash_file(file, &previous->buffer) == entry->hash;
+    }
+    if (entry->mtime == 0 || entry->mtime != file->mtime) {
+        return 0; // В архивах без каталога время изменения неизвестно — файл кодируется заново
+    }
+    if (content_hashing) *hash = hash_file(file, &previous->buffer); // В предыдущем архиве хеша нет, а в новом он должен быть
+    return 1;
+}
+
+// Функция для подготовки переноса записи CHUNKED_FILE_ENTRY предыдущего архива вместо кодирования файла.
+// Возвращает описание переносимой записи или NULL, если файл нужно кодировать.
+static reused_entry_t *find_reusable_entry(previous_archive_t *previous, const index_entry_t *entry, pack_file_t *file,
+                                           int content_hashing) {
+    uint64_t hash;
+    if (entry->entry_type != CHUNKED_FILE_ENTRY || !previous_entry_unchanged(previous, entry, file, content_hashing, &hash)) {
+        return NULL;
+    }
+
+    // Данные записи — заголовок блоков, таблица и сами блоки — лежат сразу за путем
+    chunked_header_t header;
+    if (read_chunked_header(previous->fd, entry->offset, &header) != 0) return NULL;
+    uint64_t stored_size = 0;
+    for (uint32_t i = 0; i < header.chunk_count; i++) {
+        stored_size += header.chunks[i].stored_size;
+    }
+    free(header.chunks);
+    uint64_t payload_offset = entry->offset + 1 + sizeof(uint16_t) + strlen(entry->path);
+    if (header.original_size != file->source_size || header.data_offset + stored_size > previous->index.data_end) return NULL;
+
+    reused_entry_t *reuse = malloc(sizeof(reused_entry_t));
+    if (!reuse || !(reuse->relative_path = strdup(file->relative_path))) { // Без памяти файл просто кодируется заново
+        free(reuse);
+        return NULL;
+    }
+    reuse->mtime = file->mtime; // В новый архив попадает время изменения текущего файла
+    reuse->original_size = header.original_size;
+    reuse->stored_size = stored_size;
+    reuse->hash = hash;
+    reuse->fd = previous->fd;
+    reuse->payload_offset = payload_offset;
+    reuse->payload_size = header.data_offset + stored_size - payload_offset;
+    return reuse;
+}
+
+// Функция для записи перенесенной записи: заголовок пишется заново, а таблица и блоки
+// копируются из предыдущего архива байт в байт, внутри ядра и без декодирования
+static void write_reused_entry(archive_writer_t *writer, reused_entry_t *reuse) {
+    FILE *archive = writer->file;
+    size_t slot = write_entry_header(writer, CHUNKED_FILE_ENTRY, reuse->relative_path, reuse->mtime);
+    if (slot != SIZE_MAX) {
+        index_entry_t *entry = &writer->index.entries[slot];
+        entry->original_size = reuse->original_size;
+        entry->stored_size = reuse->stored_size;
+        entry->hash = reuse->hash;
+    }
+
+    fflush(archive); // Заголовок должен оказаться в файле раньше скопированных данных
+    off_t out_offset = ftello(archive);
+    int64_t copied = copy_range(reuse->fd, reuse->payload_offset, fileno(archive), out_offset, reuse->payload_size,
+                                writer->options->buffer_size);
+    fseeko(archive, out_offset + (copied > 0 ? copied : 0), SEEK_SET);
+    if (copied != (int64_t)reuse->payload_size) {
+        fprintf(stderr, "Ошибка: не удалось перенести %s из предыдущего архива\n", reuse->relative_path);
+        writer->failed = 1; // Запись в архиве оборвана, упаковка должна завершиться ошибкой
+    }
+
+    free(reuse->relative_path);
+    free(reuse);
+}
+
+// Функция для выбора корзины таблицы дедупликации по размеру файла
+static size_t dedup_bucket(const dedup_table_t *table, uint64_t size) {
+    return (size_t)((size * HASH_PRIME1) >> 32) & (table->bucket_count - 1);
+}
+
+// Функция для вычисления хеша файла из таблицы, открывая его заново по пути
+static uint64_t dedup_file_hash(dedup_table_t *table, dedup_file_t *file) {
+    if (file->hash == 0) {
+        pack_file_t *opened = pack_file_open(table->base_fd, file->relative_path, file->relative_path, NULL);
+        if (!opened) return 0; // Файл исчез — сравнивать не с чем
+        if (opened->source_size == file->size) file->hash = hash_file(opened, &table->buffer);
+        pack_file_close(opened);
+    }
+    return file->hash;
+}
+
+// Функция для побайтового сравнения файла с первой копией из таблицы, открывая ее заново по пути.
+// Совпадение хешей не доказывает совпадения содержимого, поэтому ссылка пишется только после сравнения.
+static int dedup_same_content(dedup_table_t *table, dedup_file_t *original, pack_file_t *file) {
+    pack_file_t *opened = pack_file_open(table->base_fd, original->relative_path, original->relative_path, NULL);
+    if (!opened) return 0; // Первая копия исчезла — сравнивать не с чем
+    int same = opened->source_size == file->source_size;
+    if (same && ((!table->buffer && !(table->buffer = malloc(CHUNK_SIZE)))
+                 || (!table->original_buffer && !(table->original_buffer = malloc(CHUNK_SIZE))))) {
+        perror("malloc");
+        same = 0; // Без буферов файл просто хранится отдельно
+    }
+    for (uint32_t i = 0; same && i < file->chunk_count; i++) {
+        uint64_t remaining = file->source_size - (uint64_t)i * CHUNK_SIZE;
+        size_t len = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+        size_t bytes, original_bytes;
+        const uint8_t *data = pack_chunk_source(file, i, len, table->buffer, &bytes);
+        const uint8_t *original_data = pack_chunk_source(opened, i, len, table->original_buffer, &original_bytes);
+        same = bytes == len && original_bytes == len && memcmp(data, original_data, len) == 0;
+    }
+    pack_file_close(opened);
+    return same;
+}
+
+// Функция для поиска первой копии файла среди уже записанных.
+// Кандидаты — файлы того же размера; хеш файла считается только при наличии кандидатов
+// и сохраняется в *hash. Кандидат с тем же хешем сравнивается с файлом побайтно.
+// Возвращает номер записи первой копии или SIZE_MAX.
+static size_t dedup_find(dedup_table_t *table, pack_file_t *file, uint64_t *hash) {
+    *hash = 0;
+    if (table->bucket_count == 0) return SIZE_MAX;
+    for (size_t i = table->buckets[dedup_bucket(table, file->source_size)]; i != SIZE_MAX; i = table->files[i].next) {
+        if (table->files[i].size != file->source_size) continue;
+        if (*hash == 0 && (*hash = hash_file(file, &table->buffer)) == 0) return SIZE_MAX;
+        if (dedup_file_hash(table, &table->files[i]) == *hash && dedup_same_content(table, &table->files[i], file)) {
+            return table->files[i].slot;
+        }
+    }
+    return SIZE_MAX;
+}
+
+// Функция для добавления записанного файла в таблицу дедупликации
+static void dedup_add(dedup_table_t *table, const char *relative_path, uint64_t size, uint64_t hash, size_t slot) {
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 256;
+        dedup_file_t *files = realloc(table->files, capacity * sizeof(dedup_file_t));
+        size_t *buckets = malloc(capacity * sizeof(size_t));
+        if (!files || !buckets) { // Без места таблица просто перестает пополняться
+            perror("realloc");
+            if (files) table->files = files;
+            free(buckets);
+            return;
+        }
+        // Корзин столько же, сколько мест под файлы; цепочки перестраиваются заново
+        free(table->buckets);
+        table->files = files;
+        table->capacity = capacity;
+        table->buckets = buckets;
+        table->bucket_count = capacity;
+        for (size_t i = 0; i < capacity; i++) {
+            table->buckets[i] = SIZE_MAX;
+        }
+        for (size_t i = 0; i < table->count; i++) {
+            size_t bucket = dedup_bucket(table, table->files[i].size);
+            table->files[i].next = table->buckets[bucket];
+            table->buckets[bucket] = i;
+        }
+    }
+
+    dedup_file_t *file = &table->files[table->count];
+    if (!(file->relative_path = strdup(relative_path))) return; // Файл не станет первой копией для других
+    file->size = size;
+    file->hash = hash;
+    file->slot = slot;
+    size_t bucket = dedup_bucket(table, size);
+    file->next = table->buckets[bucket];
+    table->buckets[bucket] = table->count++;
+}
+
+// Функция для освобождения таблицы дедупликации
+static void dedup_free(dedup_table_t *table) {
+    for (size_t i = 0; i < table->count; i++) {
+        free(table->files[i].relative_path);
+    }
+    free(table->files);
+    free(table->buckets);
+    free(table->buffer);
+    free(table->original_buffer);
+}
+
+// Функция для записи копии файла: вместо данных — смещение записи первой копии и размер файла
+static void write_duplicate_entry(archive_writer_t *writer, duplicate_entry_t *duplicate) {
+    uint64_t original_offset = 0;
+    if (duplicate->original_slot < writer->index.count) {
+        original_offset = writer->index.entries[duplicate->original_slot].offset;
+    } else {
+        writer->failed = 1; // Первая копия не попала в каталог: ссылаться не на что
+    }
+    size_t slot = write_entry_header(writer, DUPLICATE_ENTRY, duplicate->relative_path, duplicate->mtime);
+    if (slot != SIZE_MAX) {
+        writer->index.entries[slot].original_size = duplicate->size;
+        writer->index.entries[slot].hash = duplicate->hash;
+    }
+
+    fwrite(&original_offset, sizeof(uint64_t), 1, writer->file); // Где в архиве лежит первая копия
+    fwrite(&duplicate->size, sizeof(uint64_t), 1, writer->file);  // Размер файла
+
+    free(duplicate->relative_path);
+    free(duplicate);
+}
+
+// Функция для создания пустого сплошного блока
+static solid_block_t *solid_block_create(void) {
+    solid_block_t *block = calloc(1, sizeof(solid_block_t));
+    if (block && !(block->data = malloc(SOLID_BLOCK_SIZE))) {
+        free(block);
+        block = NULL;
+    }
+    if (!block) perror("malloc");
+    return block;
+}
+
+// Функция для освобождения сплошного блока
+static void solid_block_free(solid_block_t *block) {
+    for (uint32_t i = 0; i < block->count; i++) {
+        free(block->members[i].relative_path);
+    }
+    free(block->members);
+    free(block->data);
+    free(block);
+}
+
+// Функция для добавления мелкого файла в сплошной блок: содержимое дописывается в буфер блока,
+// а файл сразу закрывается. Возвращает -1, если места в таблице файлов или под путь выделить не удалось.
+static int solid_block_add(solid_block_t *block, pack_file_t *file, int content_hashing) {
+    if (block->count == block->capacity) {
+        uint32_t capacity = block->capacity ? block->capacity * 2 : 64;
+        solid_member_t *members = realloc(block->members, capacity * sizeof(solid_member_t));
+        if (!members) {
+            perror("realloc");
+            return -1;
+        }
+        block->members = members;
+        block->capacity = capacity;
+    }
+
+    char *relative_path = strdup(file->relative_path);
+    if (!relative_path) {
+        perror("strdup");
+        return -1;
+    }
+    uint8_t *data = block->data + block->size;
+    size_t bytes = sa_internal_read_chunk(file->fd, data, file->source_size, 0); // Файл мог стать короче после обхода
+    if (bytes < file->source_size) {
+        report_shrunk_file(file, 0);
+        block->failed = 1;
+    }
+    solid_member_t *member = &block->members[block->count++];
+    member->relative_path = relative_path;
+    member->size = (uint32_t)bytes;
+    member->mtime = file->mtime;
+    member->hash = 0;
+    if (content_hashing) { // Хеш считается так же, как у файла из одного блока
+        uint64_t chunk_hash = sa_internal_content_hash(data, bytes, 0);
+        member->hash = combine_chunk_hashes(&chunk_hash, bytes ? 1 : 0, bytes);
+    }
+    block->size += bytes;
+    pack_file_close(file);
+    return 0;
+}
+
+// Функция для записи таблицы файлов сплошного блока: число файлов, затем путь, размер и время каждого
+static void write_solid_members(FILE *archive, const solid_member_t *members, uint32_t count) {
+    fwrite(&count, sizeof(uint32_t), 1, archive); // Число файлов в блоке
+    for (uint32_t i = 0; i < count; i++) {
+        const solid_member_t *member = &members[i];
+        uint16_t path_length = strlen(member->relative_path);
+        fwrite(&path_length, sizeof(uint16_t), 1, archive);               // Длина пути
+        fwrite(member->relative_path, sizeof(char), path_length, archive); // Путь
+        fwrite(&member->size, sizeof(uint32_t), 1, archive);              // Размер файла
+        fwrite(&member->mtime, sizeof(int64_t), 1, archive);              // Время изменения
+    }
+}
+
+// Функция для добавления файлов сплошного блока в центральный каталог записями SOLID_MEMBER_ENTRY
+static void index_solid_members(archive_writer_t *writer, const solid_member_t *members, uint32_t count, uint64_t block_offset) {
+    for (uint32_t i = 0; i < count; i++) {
+        const solid_member_t *member = &members[i];
+        size_t member_slot = index_add_entry(writer, SOLID_MEMBER_ENTRY, member->relative_path, block_offset, member->mtime);
+        if (member_slot == SIZE_MAX) break; // Каталог неполон, упаковка завершится ошибкой
+        writer->index.entries[member_slot].original_size = member->size;
+        writer->index.entries[member_slot].hash = member->hash;
+    }
+}
+
+// Функция для записи сплошного блока: заголовок с пустым путем, таблица файлов, описание
+// закодированного блока и его данные. Файлы блока попадают в центральный каталог отдельными
+// записями SOLID_MEMBER_ENTRY со смещением блока. Если data равно NULL, блок хранится без сжатия.
+static void write_solid_block(archive_writer_t *writer, solid_block_t *block, const uint8_t *data, const chunk_info_t *info) {
+    FILE *archive = writer->file;
+    if (block->failed) writer->failed = 1;
+    uint64_t block_offset = ftello(archive); // Файлы блока ссылаются на его заголовок
+    size_t slot = write_entry_header(writer, SOLID_BLOCK_ENTRY, "", 0);
+    if (slot != SIZE_MAX) {
+        writer->index.entries[slot].original_size = block->size;
+        writer->index.entries[slot].stored_size = info->stored_size;
+    }
+
+    write_solid_members(archive, block->members, block->count);
+    write_chunk_info(archive, info);
+    fwrite(data ? data : block->data, 1, info->stored_size, archive);
+
+    index_solid_members(writer, block->members, block->count, block_offset);
+    solid_block_free(block);
+}
+
+// Функция для освобождения переносимого сплошного блока
+static void reused_block_free(reused_block_t *block) {
+    for (uint32_t i = 0; i < block->matched; i++) {
+        free(block->members[i].relative_path);
+    }
+    free(block->members);
+    free(block);
+}
+
+// Функция для начала переноса сплошного блока предыдущего архива по строке блока в его каталоге.
+// Файлы блока — строки SOLID_MEMBER_ENTRY с тем же смещением сразу за строкой блока.
+static reused_block_t *reused_block_create(const previous_archive_t *previous, size_t block_row) {
+    const index_entry_t *entries = previous->index.entries;
+    size_t count = 0;
+    while (block_row + 1 + count < previous->index.count && entries[block_row + 1 + count].entry_type == SOLID_MEMBER_ENTRY
+           && entries[block_row + 1 + count].offset == entries[block_row].offset) {
+        count++;
+    }
+    if (count == 0 || count > SOLID_MAX_MEMBERS) return NULL;
+
+    reused_block_t *block = calloc(1, sizeof(reused_block_t));
+    if (block && !(block->members = malloc(count * sizeof(solid_member_t)))) {
+        free(block);
+        block = NULL;
+    }
+    if (!block) {
+        perror("malloc"); // Без памяти файлы блока просто кодируются заново
+        return NULL;
+    }
+    block->block_row = block_row;
+    block->count = (uint32_t)count;
+    return block;
+}
+
+// Функция для поиска закодированных данных переносимого блока в предыдущем архиве.
+// Таблица файлов блока должна совпасть с каталогом; описание блока и данные идут сразу за ней.
+static int reused_block_locate(const previous_archive_t *previous, reused_block_t *block) {
+    const index_entry_t *row = &previous->index.entries[block->block_row];
+    uint16_t path_length;
+    uint32_t count;
+    uint8_t fixed[CHUNK_INFO_SIZE];
+    uint64_t offset = row->offset + 1;
+    if (sa_internal_read_chunk(previous->fd, (uint8_t *)&path_length, sizeof(path_length), offset) != sizeof(path_length)) return -1;
+    offset += sizeof(uint16_t) + path_length;
+    if (sa_internal_read_chunk(previous->fd, (uint8_t *)&count, sizeof(count), offset) != sizeof(count) || count != block->count) return -1;
+    offset += sizeof(uint32_t);
+
+    // Размер таблицы файлов известен по путям из каталога
+    uint64_t original_size = 0;
+    for (uint32_t i = 0; i < block->count; i++) {
+        const index_entry_t *member = &previous->index.entries[block->block_row + 1 + i];
+        offset += sizeof(uint16_t) + strlen(member->path) + sizeof(uint32_t) + sizeof(int64_t);
+        original_size += member->original_size;
+    }
+
+    chunk_info_t info;
+    if (sa_internal_read_chunk(previous->fd, fixed, sizeof(fixed), offset) != sizeof(fixed)) return -1;
+    load_chunk_info(fixed, &info);
+    if (info.original_size != original_size || offset + CHUNK_INFO_SIZE + info.stored_size > previous->index.data_end) return -1;
+    block->fd = previous->fd;
+    block->original_size = original_size;
+    block->stored_size = info.stored_size;
+    block->payload_offset = offset;
+    return 0;
+}
+
+// Функция для записи сплошного блока, перенесенного из предыдущего архива: заголовок и таблица
+// файлов пишутся заново с текущими временами изменения, а описание и данные блока копируются
+// из предыдущего архива байт в байт, внутри ядра и без декодирования
+static void write_reused_block(archive_writer_t *writer, reused_block_t *block) {
+    FILE *archive = writer->file;
+    uint64_t block_offset = ftello(archive);
+    size_t slot = write_entry_header(writer, SOLID_BLOCK_ENTRY, "", 0);
+    if (slot != SIZE_MAX) {
+        writer->index.entries[slot].original_size = block->original_size;
+        writer->index.entries[slot].stored_size = block->stored_size;
+    }
+    write_solid_members(archive, block->members, block->count);
+
+    fflush(archive); // Заголовок должен оказаться в файле раньше скопированных данных
+    off_t out_offset = ftello(archive);
+    uint64_t payload_size = CHUNK_INFO_SIZE + block->stored_size;
+    int64_t copied = copy_range(block->fd, block->payload_offset, fileno(archive), out_offset, payload_size,
+                                writer->options->buffer_size);
+    fseeko(archive, out_offset + (copied > 0 ? copied : 0), SEEK_SET);
+    if (copied != (int64_t)payload_size) {
+        fprintf(stderr, "Ошибка: не удалось перенести сплошной блок из предыдущего архива\n");
+        writer->failed = 1; // Запись в архиве оборвана, упаковка должна завершиться ошибкой
+    }
+
+    index_solid_members(writer, block->members, block->count, block_offset);
+    reused_block_free(block);
+}
+
+// Функция для кодирования блока задания в память (выполняется рабочим потоком).
+// Возвращает -1, если не хватило памяти под закодированный блок.
+static int pack_encode_job(pack_job_t *job, uint8_t *src, codec_scratch_t *scratch, int content_hashing) {
+    pack_file_t *file = job->file;
+    size_t len = job->info.original_size; // Ожидаемый размер блока по размеру файла при обходе
+
+    job->data = malloc(len ? len : 1); // Закодированный блок не больше исходного
+    if (!job->data) {
+        perror("malloc");
+        job->info.original_size = 0; // Блок записывается пустым, чтобы таблица файла осталась согласованной,
+        job->info.stored_size = 0;   // а упаковка завершится ошибкой
+        job->info.codec = CODEC_STORED;
+        return -1;
+    }
+
+    size_t bytes;
+    const uint8_t *data = pack_chunk_source(file, job->chunk_index, len, src, &bytes);
+    if (bytes < len) {
+        report_shrunk_file(file, job->chunk_index);
+        job->failed = 1; // Блок пишется как прочитан, а упаковка завершится ошибкой
+    }
+    if (content_hashing) job->info.hash = sa_internal_content_hash(data, bytes, 0); // Данные уже в кеше процессора
+    size_t encoded = sa_internal_encode_chunk(data, bytes, job->data, &job->info, scratch);
+    if (encoded == 0 && data != src) { // Блок без сжатия из отображения писатель скопирует внутри ядра
+        free(job->data);
+        job->data = NULL;
+        return 0;
+    }
+    if (encoded == 0) { // Блок без сжатия, прочитанный в буфер потока, уходит в очередь копией
+        memcpy(job->data, data, bytes);
+        encoded = bytes;
+    }
+
+    uint8_t *shrunk = realloc(job->data, encoded ? encoded : 1); // Не держим в очереди запас под худший случай
+    if (shrunk) job->data = shrunk;
+    return 0;
+}
+
+// Функция для кодирования сплошного блока задания (выполняется рабочим потоком).
+// Блок без сжатия не копируется: писатель выведет его прямо из буфера блока.
+static void pack_encode_solid(pack_job_t *job, codec_scratch_t *scratch) {
+    solid_block_t *block = job->solid;
+    job->data = malloc(block->size ? block->size : 1);
+    if (!job->data || sa_internal_encode_chunk(block->data, block->size, job->data, &job->info, scratch) == 0) {
+        free(job->data);
+        job->data = NULL;
+        job->info.codec = CODEC_STORED;
+        job->info.original_size = job->info.stored_size = (uint32_t)block->size;
+    }
+}
+
+// Функция рабочего потока: забирает задания по порядку и кодирует блоки независимо друг от друга
+static void *pack_worker(void *arg) {
+    pack_pipeline_t *pipeline = arg;
+    uint8_t *src = malloc(CHUNK_SIZE); // Буфер исходных данных блока, свой у каждого потока
+    codec_scratch_t *scratch = malloc(sizeof(codec_scratch_t)); // Рабочая память кодировщика потока
+    if (!src || !scratch) perror("malloc");
+    int content_hashing = pipeline->writer->options->content_hashing;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        // Ждем появления задания, которое еще никто не взял
+        while (pipeline->claim == pipeline->tail && !pipeline->finished) {
+            pthread_cond_wait(&pipeline->work_ready, &pipeline->lock);
+        }
+        if (pipeline->claim == pipeline->tail) break; // Обход завершен, заданий больше не будет
+
+        pack_job_t *job = &pipeline->jobs[pipeline->claim % pipeline->capacity];
+        pipeline->claim++;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        // Директории и пустые файлы кодировать не нужно
+        if (job->solid && scratch) {
+            pack_encode_solid(job, scratch);
+        } else if (job->solid) { // Без рабочей памяти блок хранится без сжатия
+            job->info.codec = CODEC_STORED;
+            job->info.original_size = job->info.stored_size = (uint32_t)job->solid->size;
+        } else if (job->file && job->chunk_index < job->file->chunk_count) {
+            if (!src || !scratch || pack_encode_job(job, src, scratch, content_hashing) != 0) {
+                job->info.original_size = 0; // Без буфера блок записывается пустым, а упаковка завершится ошибкой
+                job->failed = 1;
+            }
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&pipeline->job_done); // Писатель может ждать именно это задание
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    free(src);
+    free(scratch);
+    return NULL;
+}
+
+// Функция записи готового задания в архив (выполняется потоком-писателем)
+static void pack_write_job(archive_writer_t *writer, pack_job_t *job) {
+    if (job->failed) writer->failed = 1; // Блок не закодирован: архив будет неполным
+    if (job->entry_type == DIRECTORY_ENTRY) {
+        if (job->relative_path) write_entry_header(writer, DIRECTORY_ENTRY, job->relative_path, job->mtime);
+        return;
+    }
+    if (job->reuse) { // Запись, перенесенная из предыдущего архива
+        write_reused_entry(writer, job->reuse);
+        return;
+    }
+    if (job->duplicate) { // Копия файла, уже записанного в архив
+        write_duplicate_entry(writer, job->duplicate);
+        return;
+    }
+    if (job->solid) { // Сплошной блок мелких файлов
+        write_solid_block(writer, job->solid, job->data, &job->info);
+        return;
+    }
+    if (job->reuse_block) { // Сплошной блок, перенесенный из предыдущего архива
+        write_reused_block(writer, job->reuse_block);
+        return;
+    }
+
+    pack_file_t *file = job->file;
+    if (job->chunk_index == 0) { // Первый блок открывает запись файла
+        pack_file_begin(writer, file);
+    }
+    if (job->chunk_index < file->chunk_count) {
+        pack_file_chunk(writer, file, job->chunk_index, job->data, &job->info);
+    }
+    if (job->chunk_index + 1 >= file->chunk_count) { // Последний блок закрывает запись
+        pack_file_end(writer, file);
+    }
+}
+
+// Функция потока-писателя: выводит задания строго в порядке обхода
+static void *pack_writer(void *arg) {
+    pack_pipeline_t *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        // Ждем, пока будет готово самое старое задание или закончится обход
+        while (!(pipeline->head < pipeline->tail && pipeline->jobs[pipeline->head % pipeline->capacity].done)
+               && !(pipeline->head == pipeline->tail && pipeline->finished)) {
+            pthread_cond_wait(&pipeline->job_done, &pipeline->lock);
+        }
+        if (pipeline->head == pipeline->tail) break; // Все задания записаны
+
+        pack_job_t *job = &pipeline->jobs[pipeline->head % pipeline->capacity];
+        pthread_mutex_unlock(&pipeline->lock);
+
+        pack_write_job(pipeline->writer, job);
+        free(job->relative_path);
+        free(job->data);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->in_flight_bytes -= job->budget;
+        pipeline->head++;
+        pthread_cond_signal(&pipeline->not_full); // Освободилось место в очереди
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// Функция для остановки потоков конвейера и освобождения его очереди.
+// Запущенные рабочие потоки дорабатывают оставшиеся задания, писатель выводит их.
+static void pack_pipeline_stop(pack_pipeline_t *pipeline, int writer_started) {
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->finished = 1;
+    pthread_cond_broadcast(&pipeline->work_ready);
+    pthread_cond_broadcast(&pipeline->job_done);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        pthread_join(pipeline->workers[i], NULL);
+    }
+    if (writer_started) pthread_join(pipeline->writer_thread, NULL);
+
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->not_full);
+    pthread_cond_destroy(&pipeline->work_ready);
+    pthread_cond_destroy(&pipeline->job_done);
+    free(pipeline->jobs);
+    free(pipeline->workers);
+}
+
+// Функция для запуска конвейера упаковки: threads рабочих потоков и один писатель.
+// При threads <= 1 записи пишутся сразу в вызывающем потоке.
+static int pack_pipeline_start(pack_pipeline_t *pipeline, archive_writer_t *writer, int threads) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->writer = writer;
+    pipeline->threads = threads;
+    sa_internal_rle_init_kernels(); // Выбираем ядра до запуска потоков
+    if (threads <= 1) { // Без потоков блоки кодируются в одной паре буферов
+        pipeline->src = malloc(CHUNK_SIZE);
+        pipeline->dst = malloc(CHUNK_SIZE);
+        pipeline->scratch = malloc(sizeof(codec_scratch_t));
+        if (!pipeline->src || !pipeline->dst || !pipeline->scratch) {
+            perror("malloc");
+            free(pipeline->src);
+            free(pipeline->dst);
+            free(pipeline->scratch);
+            return -1;
+        }
+        return 0;
+    }
+
+    pipeline->capacity = (size_t)threads * PACK_QUEUE_PER_THREAD; // Ограничение длины очереди
+    pipeline->jobs = calloc(pipeline->capacity, sizeof(pack_job_t));
+    pipeline->workers = calloc(threads, sizeof(pthread_t));
+    if (!pipeline->jobs || !pipeline->workers) {
+        perror("calloc");
+        free(pipeline->jobs);
+        free(pipeline->workers);
+        return -1;
+    }
+
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->not_full, NULL);
+    pthread_cond_init(&pipeline->work_ready, NULL);
+    pthread_cond_init(&pipeline->job_done, NULL);
+
+    // Очередь пуста, поэтому при неудаче писатель и рабочие потоки сразу завершатся
+    if (pthread_create(&pipeline->writer_thread, NULL, pack_writer, pipeline) == 0) {
+        for (; pipeline->worker_count < threads; pipeline->worker_count++) {
+            if (pthread_create(&pipeline->workers[pipeline->worker_count], NULL, pack_worker, pipeline) != 0) break;
+        }
+        if (pipeline->worker_count > 0) return 0; // Работаем с теми потоками, которые удалось создать
+        pack_pipeline_stop(pipeline, 1);
+    } else {
+        pack_pipeline_stop(pipeline, 0);
+    }
+    fprintf(stderr, "Предупреждение: не удалось создать потоки, упаковка идет в одном потоке\n");
+    return pack_pipeline_start(pipeline, writer, 1);
+}
+
+// Функция для добавления задания в очередь; ждет, пока в очереди появится место
+static void pack_pipeline_push(pack_pipeline_t *pipeline, const pack_job_t *job) {
+    pthread_mutex_lock(&pipeline->lock);
+    // Очередь ограничена и по числу заданий, и по объему данных в памяти
+    while (pipeline->tail - pipeline->head == pipeline->capacity
+           || (pipeline->tail > pipeline->head && pipeline->in_flight_bytes + job->budget > PACK_MEMORY_BUDGET)) {
+        pthread_cond_wait(&pipeline->not_full, &pipeline->lock);
+    }
+
+    pipeline->jobs[pipeline->tail % pipeline->capacity] = *job;
+    pipeline->in_flight_bytes += job->budget;
+    pipeline->tail++;
+    pthread_cond_signal(&pipeline->work_ready); // Будим один рабочий поток
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Функция для постановки директории в очередь конвейера (вызывается потоком обхода)
+static void pack_pipeline_submit_directory(pack_pipeline_t *pipeline, const char *relative_path, int64_t mtime) {
+    pipeline->submitted++; // Каждое задание обхода дает ровно одну запись в каталоге
+    if (pipeline->threads <= 1) {
+        write_entry_header(pipeline->writer, DIRECTORY_ENTRY, relative_path, mtime);
+        return;
+    }
+
+    pack_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entry_type = DIRECTORY_ENTRY;
+    job.relative_path = strdup(relative_path);
+    job.failed = !job.relative_path; // Без пути писатель пропустит директорию и завершит упаковку ошибкой
+    job.mtime = mtime;
+    pack_pipeline_push(pipeline, &job);
+}
+
+// Функция для отправки наполненного сплошного блока в конвейер и начала нового блока
+static void pack_pipeline_flush_solid(pack_pipeline_t *pipeline) {
+    solid_block_t *block = pipeline->solid;
+    if (!block || block->count == 0) return;
+    pipeline->solid = solid_block_create(); // Без памяти под новый блок мелкие файлы пойдут отдельными записями
+    pipeline->submitted += 1 + block->count; // Блок и его файлы — отдельные записи каталога
+
+    if (pipeline->threads <= 1) {
+        chunk_info_t info;
+        int compressed = sa_internal_encode_chunk(block->data, block->size, pipeline->dst, &info, pipeline->scratch) != 0;
+        write_solid_block(pipeline->writer, block, compressed ? pipeline->dst : NULL, &info);
+        return;
+    }
+
+    pack_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entry_type = SOLID_BLOCK_ENTRY;
+    job.solid = block;
+    job.budget = block->size;
+    pack_pipeline_push(pipeline, &job);
+}
+
+// Функция для постановки копии уже записанного файла: вместо данных пишется ссылка на первую копию.
+// Возвращает -1, если не хватило памяти, — тогда файл хранится как обычный.
+static int pack_pipeline_submit_duplicate(pack_pipeline_t *pipeline, pack_file_t *file, size_t original_slot, uint64_t hash) {
+    pack_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entry_type = CHUNKED_FILE_ENTRY;
+    if (!(job.duplicate = malloc(sizeof(duplicate_entry_t)))) return -1;
+    if (!(job.duplicate->relative_path = strdup(file->relative_path))) {
+        free(job.duplicate);
+        return -1;
+    }
+    pipeline->submitted++;
+    job.duplicate->mtime = file->mtime;
+    job.duplicate->size = file->source_size;
+    job.duplicate->hash = hash;
+    job.duplicate->original_slot = original_slot;
+    pack_file_close(file);
+    if (pipeline->threads <= 1) {
+        write_duplicate_entry(pipeline->writer, job.duplicate);
+    } else {
+        pack_pipeline_push(pipeline, &job);
+    }
+    return 0;
+}
+
+// Функция для переноса копии из предыдущего архива: неизменившийся файл, который там был ссылкой,
+// становится ссылкой на перенесенную первую копию, не читая ни один из файлов.
+// Возвращает -1, если перенести копию нельзя и файл нужно хранить как обычный.
+static int pack_pipeline_reuse_duplicate(pack_pipeline_t *pipeline, const index_entry_t *entry, pack_file_t *file) {
+    previous_archive_t *previous = pipeline->previous;
+    uint64_t hash, original_offset;
+    if (!previous_entry_unchanged(previous, entry, file, pipeline->writer->options->content_hashing, &hash)) return -1;
+    uint64_t payload_offset = entry->offset + 1 + sizeof(uint16_t) + strlen(entry->path);
+    if (sa_internal_read_chunk(previous->fd, (uint8_t *)&original_offset, sizeof(uint64_t), payload_offset) != sizeof(uint64_t)) return -1;
+
+    // Строки каталога идут в порядке записи, поэтому первая копия находится двоичным поиском по смещению
+    size_t low = 0, high = previous->index.count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (previous->index.entries[middle].offset < original_offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == previous->index.count || previous->index.entries[low].offset != original_offset
+        || previous->index.entries[low].original_size != file->source_size || previous->new_slots[low] == SIZE_MAX) {
+        return -1; // Первая копия не перенесена: файл проверит дедупликация
+    }
+    return pack_pipeline_submit_duplicate(pipeline, file, previous->new_slots[low], hash);
+}
+
+// Функция для хранения файла в новом архиве: копией, в сплошном блоке или отдельной записью
+static void pack_pipeline_store_file(pack_pipeline_t *pipeline, pack_file_t *file);
+
+// Функция для отказа от переноса отложенного сплошного блока: его неизменившиеся файлы
+// открываются заново по пути от базовой директории и хранятся как новые
+static void pack_pipeline_release_block(pack_pipeline_t *pipeline) {
+    reused_block_t *block = pipeline->reuse_block;
+    if (!block) return;
+    pipeline->reuse_block = NULL;
+    for (uint32_t i = 0; i < block->matched; i++) {
+        const char *relative_path = block->members[i].relative_path;
+        errno = 0;
+        pack_file_t *file = pack_file_open(pipeline->base_fd, relative_path, relative_path, NULL);
+        if (file) pack_pipeline_store_file(pipeline, file);
+        if (!file && errno == ENOMEM) pipeline->walk_failed = 1; // Файл пропущен не потому, что исчез
+    }
+    reused_block_free(block);
+}
+
+// Функция для откладывания файла, который в предыдущем архиве лежал в сплошном блоке.
+// Файлы блока должны встретиться по порядку и без изменений; когда совпал последний,
+// блок переносится целиком. Возвращает -1, если файл нужно хранить как новый.
+static int pack_pipeline_hold_member(pack_pipeline_t *pipeline, const index_entry_t *entry, pack_file_t *file) {
+    previous_archive_t *previous = pipeline->previous;
+    size_t row = (size_t)(entry - previous->index.entries);
+    reused_block_t *block = pipeline->reuse_block;
+    if (!block || row != block->block_row + 1 + block->matched) {
+        if (block && row > block->block_row && row <= block->block_row + block->count) {
+            pack_pipeline_release_block(pipeline); // Файлы блока встретились не по порядку
+            return -1;
+        }
+        const index_entry_t *block_row = row > 0 ? entry - 1 : NULL;
+        if (!block_row || block_row->entry_type != SOLID_BLOCK_ENTRY || block_row->offset != entry->offset) {
+            return -1; // Первый файл блока уже не совпал — остальные переносить не с чем
+        }
+        pack_pipeline_release_block(pipeline);
+        if (!(block = reused_block_create(previous, row - 1))) return -1;
+        pipeline->reuse_block = block;
+    }
+
+    uint64_t hash;
+    solid_member_t *member = &block->members[block->matched];
+    if (!previous_entry_unchanged(previous, entry, file, pipeline->writer->options->content_hashing, &hash)
+        || !(member->relative_path = strdup(file->relative_path))) {
+        pack_pipeline_release_block(pipeline);
+        return -1;
+    }
+    member->size = (uint32_t)file->source_size;
+    member->mtime = file->mtime; // В новый архив попадает время изменения текущего файла
+    member->hash = hash;
+    block->matched++;
+    pack_file_close(file);
+    if (block->matched < block->count) return 0;
+
+    // Совпали все файлы блока: он уходит в архив без перекодирования
+    if (reused_block_locate(previous, block) != 0) {
+        pack_pipeline_release_block(pipeline);
+        return 0;
+    }
+    pipeline->reuse_block = NULL;
+    pipeline->submitted += 1 + block->count; // Блок и его файлы — отдельные записи каталога
+    if (pipeline->threads <= 1) {
+        write_reused_block(pipeline->writer, block);
+        return 0;
+    }
+    pack_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entry_type = SOLID_BLOCK_ENTRY;
+    job.reuse_block = block;
+    pack_pipeline_push(pipeline, &job);
+    return 0;
+}
+
+// Функция для постановки открытого файла в очередь конвейера (вызывается потоком обхода).
+// Неизменившийся файл переносится из предыдущего архива: отдельная запись — сразу,
+// файл сплошного блока — вместе со всем блоком, копия — ссылкой на перенесенную первую копию.
+// Проверка идет раньше дедупликации, иначе поиск копии читал бы и хешировал неизменившиеся файлы.
+static void pack_pipeline_submit_file(pack_pipeline_t *pipeline, pack_file_t *file) {
+    previous_archive_t *previous = pipeline->previous;
+    const index_entry_t *entry = previous ? find_previous_entry(previous, file->relative_path) : NULL;
+    if (entry && entry->entry_type == SOLID_MEMBER_ENTRY && pack_pipeline_hold_member(pipeline, entry, file) == 0) return;
+    if (entry && entry->entry_type == DUPLICATE_ENTRY && pack_pipeline_reuse_duplicate(pipeline, entry, file) == 0) return;
+
+    pack_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entry_type = CHUNKED_FILE_ENTRY;
+    job.reuse = entry ? find_reusable_entry(previous, entry, file, pipeline->writer->options->content_hashing) : NULL;
+    if (job.reuse) {
+        // Перенесенная запись — первая копия для следующих файлов и для перенесенных копий
+        size_t slot = pipeline->submitted;
+        previous->new_slots[entry - previous->index.entries] = slot;
+        if (pipeline->dedup && file->source_size >= DEDUP_MIN_SIZE) {
+            dedup_add(pipeline->dedup, file->relative_path, file->source_size, job.reuse->hash, slot);
+        }
+        pipeline->submitted++;
+        pack_file_close(file);
+        if (pipeline->threads <= 1) {
+            write_reused_entry(pipeline->writer, job.reuse);
+        } else {
+            pack_pipeline_push(pipeline, &job);
+        }
+        return;
+    }
+    pack_pipeline_store_file(pipeline, file);
+}
+
+// Функция для хранения файла, который нельзя перенести из предыдущего архива.
+// Файл превращается в задания по одному на блок, поэтому даже один большой файл
+// кодируется всеми рабочими потоками.
+static void pack_pipeline_store_file(pack_pipeline_t *pipeline, pack_file_t *file) {
+    size_t slot = pipeline->submitted;
+    uint64_t hash = 0;
+    pack_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entry_type = CHUNKED_FILE_ENTRY;
+    int solid = pipeline->solid && file->source_size <= SOLID_MAX_FILE_SIZE; // Файл пойдет в сплошной блок
+    int content_hashing = pipeline->writer->options->content_hashing;
+
+    // Копия уже записанного файла хранится ссылкой на первую копию.
+    // Файлы сплошных блоков не дедуплицируются: ссылка может указывать только на запись с данными.
+    dedup_table_t *dedup = pipeline->dedup && !solid && file->source_size >= DEDUP_MIN_SIZE ? pipeline->dedup : NULL;
+    size_t original_slot = dedup ? dedup_find(dedup, file, &hash) : SIZE_MAX;
+    if (original_slot != SIZE_MAX && pack_pipeline_submit_duplicate(pipeline, file, original_slot, hash) == 0) return;
+    if (dedup) dedup_add(dedup, file->relative_path, file->source_size, hash, slot);
+
+    // Мелкий файл дописывается в сплошной блок, который уйдет в конвейер, когда заполнится
+    if (solid) {
+        if (pipeline->solid->size + file->source_size > SOLID_BLOCK_SIZE || pipeline->solid->count == SOLID_MAX_MEMBERS) {
+            pack_pipeline_flush_solid(pipeline);
+        }
+        if (pipeline->solid && solid_block_add(pipeline->solid, file, content_hashing) == 0) return;
+    }
+
+    pipeline->submitted++;
+    if (pipeline->threads <= 1) {
+        write_file_entry(pipeline->writer, file, pipeline->src, pipeline->dst, pipeline->scratch);
+        return;
+    }
+
+    job.file = file;
+
+    // Пустой файл — одно задание без данных, которое только пишет заголовок
+    uint64_t size = file->source_size;
+    uint32_t jobs = file->chunk_count ? file->chunk_count : 1;
+    for (uint32_t i = 0; i < jobs; i++) {
+        uint64_t offset = (uint64_t)i * CHUNK_SIZE;
+        job.chunk_index = i;
+        job.info.original_size = (uint32_t)(size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE);
+        job.budget = job.info.original_size;
+        pack_pipeline_push(pipeline, &job);
+    }
+}
+
+// Функция для завершения конвейера: дожидается записи всех заданий и освобождает ресурсы
+static void pack_pipeline_finish(pack_pipeline_t *pipeline) {
+    pack_pipeline_flush_solid(pipeline); // Последний неполный сплошной блок
+    if (pipeline->solid) {
+        solid_block_free(pipeline->solid);
+        pipeline->solid = NULL;
+    }
+
+    if (pipeline->threads <= 1) {
+        free(pipeline->src);
+        free(pipeline->dst);
+        free(pipeline->scratch);
+    } else {
+        pack_pipeline_stop(pipeline, 1);
+    }
+    if (pipeline->walk_failed) pipeline->writer->failed = 1; // Писатель уже остановлен
+}
+
+// Функция для сравнения элементов листинга по номеру inode
+static int compare_inodes(const void *a, const void *b) {
+    ino_t left = ((const walk_entry_t *)a)->inode, right = ((const walk_entry_t *)b)->inode;
+    return (left > right) - (left < right);
+}
+
+// Функция для соединения относительного пути директории и имени в новой строке
+static char *join_path(const char *dir_path, const char *name) {
+    size_t dir_length = strlen(dir_path), name_length = strlen(name);
+    char *path = malloc(dir_length + name_length + 2);
+    if (path) {
+        memcpy(path, dir_path, dir_length);
+        path[dir_length] = '/';
+        memcpy(path + dir_length + 1, name, name_length + 1);
+    }
+    return path;
+}
+
+// Функция для чтения всех элементов директории, кроме "." и "..".
+// Если памяти не хватило, листинг обрывается и *failed становится 1.
+static walk_entry_t *read_directory(DIR *dir, size_t *count, int *failed) {
+    walk_entry_t *entries = NULL;
+    size_t capacity = 0;
+    *count = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            walk_entry_t *grown = realloc(entries, capacity * sizeof(walk_entry_t));
+            if (!grown) {
+                perror("realloc");
+                *failed = 1;
+                break;
+            }
+            entries = grown;
+        }
+        if (!(entries[*count].name = strdup(entry->d_name))) {
+            perror("strdup");
+            *failed = 1;
+            break;
+        }
+        entries[*count].inode = entry->d_ino;
+        entries[*count].type = entry->d_type;
+        (*count)++;
+    }
+    return entries;
+}
+
+// Функция итеративного обхода дерева для упаковки.
+// Вместо рекурсии используется стек еще не прочитанных директорий, пути хранятся в куче.
+// Элементы открываются и проверяются через openat/fstatat относительно дескрипторов директорий;
+// тип берется из d_type, а fstatat нужен только там, где файловая система тип не сообщила
+// или элемент является символической ссылкой. Каждый файл получает ровно один stat: результат
+// fstatat передается в pack_file_open. Директория получает fstat ради времени изменения,
+// а директория без d_type или за ссылкой — еще и fstatat при чтении родителя.
+// Директория попадает в архив раньше своего содержимого, что и требуется распаковке.
+static void walk_tree(pack_pipeline_t *pipeline, const char *base_path, const char *root_name) {
+    int base_fd = open(base_path, O_RDONLY | O_DIRECTORY);
+    if (base_fd < 0) {
+        perror("open");
+        return;
+    }
+
+    pipeline->base_fd = base_fd; // Отложенные файлы сплошного блока открываются заново от базы
+    if (pipeline->dedup) pipeline->dedup->base_fd = base_fd; // Пути таблицы дедупликации отсчитываются от базы
+
+    struct stat root_stat;
+    if (fstatat(base_fd, root_name, &root_stat, 0) != 0) {
+        perror("stat"); // Выводим сообщение об ошибке, если не удалось получить информацию
+        close(base_fd);
+        return;
+    }
+    if (!S_ISDIR(root_stat.st_mode)) { // Упаковывается один файл
+        errno = 0;
+        pack_file_t *file = S_ISREG(root_stat.st_mode) ? pack_file_open(base_fd, root_name, root_name, &root_stat) : NULL;
+        if (file) pack_pipeline_submit_file(pipeline, file);
+        if (!file && errno == ENOMEM) pipeline->walk_failed = 1;
+        pack_pipeline_release_block(pipeline);
+        close(base_fd);
+        return;
+    }
+
+    // Стек директорий, ожидающих чтения
+    char **pending = malloc(sizeof(char *));
+    size_t pending_count = 0, pending_capacity = 1;
+    if (!pending || !(pending[0] = strdup(root_name))) {
+        perror("malloc");
+        pipeline->walk_failed = 1;
+        free(pending);
+        close(base_fd);
+        return;
+    }
+    pending_count = 1;
+
+    while (pending_count > 0) {
+        char *dir_path = pending[--pending_count];
+        int dir_fd = openat(base_fd, dir_path, O_RDONLY | O_DIRECTORY);
+        struct stat dir_stat;
+        DIR *dir = NULL;
+        if (dir_fd < 0 || fstat(dir_fd, &dir_stat) != 0 || !(dir = fdopendir(dir_fd))) {
+            perror("opendir"); // Выводим сообщение об ошибке, если не удалось открыть директорию
+            if (dir_fd >= 0) close(dir_fd);
+            free(dir_path);
+            continue;
+        }
+
+        // Сначала сама директория, затем ее содержимое
+        pack_pipeline_submit_directory(pipeline, dir_path, dir_stat.st_mtime);
+
+        size_t count;
+        walk_entry_t *entries = read_directory(dir, &count, &pipeline->walk_failed);
+        if (pipeline->writer->options->inode_order && count > 1) { // Порядок inode уменьшает перемещения головок на HDD
+            qsort(entries, count, sizeof(walk_entry_t), compare_inodes);
+        }
+
+        size_t first_subdir = pending_count; // Поддиректории этой директории лягут в стек отсюда
+        for (size_t i = 0; i < count; i++) {
+            unsigned char type = entries[i].type;
+            struct stat entry_stat;
+            const struct stat *known = NULL; // stat элемента, если он уже получен
+            if (type == DT_UNKNOWN || type == DT_LNK) { // Тип неизвестен или нужна цель ссылки
+                if (fstatat(dirfd(dir), entries[i].name, &entry_stat, 0) != 0) {
+                    perror("stat");
+                    type = DT_UNKNOWN;
+                } else {
+                    type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : (S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+                    known = &entry_stat;
+                }
+            }
+
+            char *child_path = (type == DT_DIR || type == DT_REG) ? join_path(dir_path, entries[i].name) : NULL;
+            if (!child_path && (type == DT_DIR || type == DT_REG)) pipeline->walk_failed = 1; // Не хватило памяти под путь
+            if (child_path && strlen(child_path) >= PATH_MAX) { // Такой путь не поместится в заголовок записи
+                fprintf(stderr, "Предупреждение: путь %s/%s слишком длинный, пропущен\n", dir_path, entries[i].name);
+                free(child_path);
+                child_path = NULL;
+            }
+            if (child_path && type == DT_REG) {
+                errno = 0;
+                pack_file_t *file = pack_file_open(dirfd(dir), entries[i].name, child_path, known);
+                if (file) pack_pipeline_submit_file(pipeline, file);
+                if (!file && errno == ENOMEM) pipeline->walk_failed = 1; // Файл пропущен не потому, что исчез
+                free(child_path);
+            } else if (child_path) {
+                if (pending_count == pending_capacity) {
+                    char **grown = realloc(pending, pending_capacity * 2 * sizeof(char *));
+                    if (!grown) {
+                        perror("realloc");
+                        pipeline->walk_failed = 1;
+                        free(child_path);
+                        free(entries[i].name);
+                        continue;
+                    }
+                    pending = grown;
+                    pending_capacity *= 2;
+                }
+                pending[pending_count++] = child_path;
+            }
+            free(entries[i].name);
+        }
+        free(entries);
+        closedir(dir);
+        free(dir_path);
+
+        // Разворачиваем добавленные поддиректории, чтобы они читались в порядке листинга
+        for (size_t i = first_subdir, j = pending_count; i + 1 < j; i++, j--) {
+            char *swap = pending[i];
+            pending[i] = pending[j - 1];
+            pending[j - 1] = swap;
+        }
+    }
+
+    free(pending);
+    pack_pipeline_release_block(pipeline); // Блок, файлы которого встретились не все, хранится заново
+    close(base_fd);
+}
+
+// Функция для заполнения параметров значениями по умолчанию
+void sa_options_init(sa_options_t *options) {
+    memset(options, 0, sizeof(*options));
+    options->buffer_size = DEFAULT_BUFFER_SIZE;
+    options->deduplicate = 1; // Одинаковые файлы по умолчанию хранятся один раз
+}
+
+// Функция для разбора размера вида 65536, 512K, 4M или 1G
+int sa_parse_size(const char *text, size_t min, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text) return -1; // Строка не начинается с числа
+
+    // Учитываем необязательный суффикс единиц измерения
+    switch (*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || value < min || value > SIZE_MAX / 4) return -1;
+
+    *size = (size_t)value;
+    return 0;
+}
+
+// Функция для получения параметров операции: NULL заменяется параметрами по умолчанию,
+// а нулевое число потоков — числом доступных процессоров
+static void resolve_options(const sa_options_t *options, sa_options_t *resolved) {
+    if (options) {
+        *resolved = *options;
+    } else {
+        sa_options_init(resolved);
+    }
+    if (resolved->buffer_size < MIN_BUFFER_SIZE) resolved->buffer_size = MIN_BUFFER_SIZE;
+    if (resolved->threads <= 0) { // По умолчанию используем все доступные процессоры
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        resolved->threads = cpus < 1 ? 1 : (cpus > MAX_THREADS ? MAX_THREADS : (int)cpus);
+    }
+    if (resolved->threads > MAX_THREADS) resolved->threads = MAX_THREADS;
+}
+
+// Функция для упаковки дерева в архив; в режиме -update неизменившиеся файлы
+// переносятся из предыдущего архива previous (NULL при обычной упаковке)
+static int pack_into(const char *input_path, const char *archive_path, previous_archive_t *previous, const sa_options_t *options) {
+    char *archive_buffer = NULL;
+    FILE *archive = open_archive(archive_path, "wb", options->buffer_size, &archive_buffer); // Открываем архив для записи в бинарном режиме
+    if (!archive) {
+        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
+        return -1;
+    }
+
+    // Получаем абсолютный путь к входному файлу или директории
+    char *input_realpath = realpath(input_path, NULL);
+    if (!input_realpath) {
+        perror("realpath"); // Выводим сообщение об ошибке, если не удалось получить абсолютный путь
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+
+    // Создаем копии строк, так как функции dirname() и basename() могут модифицировать исходные строки
+    char *dirname_copy = strdup(input_realpath);
+    char *basename_copy = strdup(input_realpath);
+    if (!dirname_copy || !basename_copy) {
+        perror("strdup");
+        free(dirname_copy);
+        free(basename_copy);
+        free(input_realpath);
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+    char *input_dirname = dirname(dirname_copy);    // Получаем родительскую директорию
+    char *input_basename = basename(basename_copy); // Получаем имя входного файла или директории
+
+    // Запускаем рабочие потоки и писателя
+    archive_writer_t writer = {archive, {NULL, 0, 0, 0}, options, 0};
+    pack_pipeline_t pipeline;
+    int result = pack_pipeline_start(&pipeline, &writer, options->threads);
+    if (result == 0) {
+        pipeline.previous = previous;
+        dedup_table_t dedup;
+        memset(&dedup, 0, sizeof(dedup));
+        if (options->deduplicate) pipeline.dedup = &dedup;
+        if (options->solid_blocks) pipeline.solid = solid_block_create();
+
+        // Начинаем упаковку с родительской директории и относительного пути, содержащего имя входного файла/директории
+        walk_tree(&pipeline, input_dirname, input_basename);
+
+        pack_pipeline_finish(&pipeline); // Дожидаемся записи всех заданий
+        dedup_free(&dedup);
+        write_central_directory(&writer); // Дописываем каталог для быстрого поиска записей
+        free_index(&writer.index);
+        if (ferror(archive)) {
+            perror("fwrite"); // Архив записан не полностью
+            result = -1;
+        } else if (writer.failed) {
+            fprintf(stderr, "Ошибка: архив %s записан не полностью\n", archive_path);
+            result = -1;
+        }
+    }
+
+    free(dirname_copy);   // Освобождаем выделенную память
+    free(basename_copy);
+    free(input_realpath);
+    if (fclose(archive) != 0) result = -1; // Закрываем архив; при закрытии дописывается буфер
+    free(archive_buffer); // Освобождаем буфер архива
+    return result;
+}
+
+// Функция для архивирования файлов и директорий
+int sa_pack(const char *input_path, const char *archive_path, const sa_options_t *options) {
+    sa_options_t resolved;
+    resolve_options(options, &resolved);
+    return pack_into(input_path, archive_path, NULL, &resolved);
+}
+
+// Функция для инкрементальной упаковки: дерево упаковывается в новый архив, но файлы,
+// не изменившиеся с момента создания предыдущего архива, не читаются и не кодируются —
+// их сжатые данные копируются из предыдущего архива без декодирования
+int sa_update(const char *previous_path, const char *input_path, const char *archive_path, const sa_options_t *options) {
+    sa_options_t resolved;
+    resolve_options(options, &resolved);
+
+    char *archive_buffer = NULL;
+    FILE *archive = open_archive(previous_path, "rb", resolved.buffer_size, &archive_buffer);
+    if (!archive) {
+        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
+        return -1;
+    }
+
+    // Новый архив пишется с нуля, поэтому он не может совпадать с предыдущим
+    struct stat previous_stat, archive_stat;
+    if (fstat(fileno(archive), &previous_stat) == 0 && stat(archive_path, &archive_stat) == 0
+        && previous_stat.st_dev == archive_stat.st_dev && previous_stat.st_ino == archive_stat.st_ino) {
+        fprintf(stderr, "Ошибка: новый архив должен отличаться от предыдущего\n");
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+
+    previous_archive_t previous;
+    memset(&previous, 0, sizeof(previous));
+    previous.fd = fileno(archive);
+    if (read_index(archive, &previous.index) != 0) {
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+
+    // Записи сортируются по пути, чтобы каждый файл находился двоичным поиском
+    int result = -1;
+    previous.by_path = malloc((previous.index.count ? previous.index.count : 1) * sizeof(index_entry_t *));
+    previous.new_slots = malloc((previous.index.count ? previous.index.count : 1) * sizeof(size_t));
+    if (!previous.by_path || !previous.new_slots) {
+        perror("malloc");
+    } else {
+        for (size_t i = 0; i < previous.index.count; i++) {
+            previous.by_path[i] = &previous.index.entries[i];
+            previous.new_slots[i] = SIZE_MAX; // Ни одна запись еще не перенесена
+        }
+        previous.count = previous.index.count;
+        qsort(previous.by_path, previous.count, sizeof(index_entry_t *), compare_entry_paths);
+        result = pack_into(input_path, archive_path, &previous, &resolved);
+    }
+
+    free(previous.by_path);
+    free(previous.new_slots);
+    free(previous.buffer);
+    free_index(&previous.index);
+    fclose(archive);
+    free(archive_buffer);
+    return result;
+}
+
+// Функция для чтения описания одного блока из таблицы
+static int read_chunk_info(FILE *archive, chunk_info_t *info) {
+    if (fread(&info->original_size, sizeof(uint32_t), 1, archive) != 1) return -1;
+    if (fread(&info->stored_size, sizeof(uint32_t), 1, archive) != 1) return -1;
+    if (fread(&info->codec, sizeof(uint8_t), 1, archive) != 1) return -1;
+    return 0;
+}
+
+// Функция для распаковки одного блока, данные которого начинаются с текущей позиции архива.
+// Блок без сжатия переносится из архива в выходной файл внутри ядра, минуя буферы потоков;
+// остальные читаются в src и декодируются в dst (буферы вмещают блок).
+static int unpack_chunk(FILE *archive, FILE *out, const chunk_info_t *info, uint8_t *src, uint8_t *dst, size_t buffer_size) {
+    if (info->codec == CODEC_STORED && info->stored_size == info->original_size) {
+        off_t in_offset = ftello(archive);
+        fflush(out);
+        off_t out_offset = ftello(out);
+        if (copy_range(fileno(archive), in_offset, fileno(out), out_offset, info->stored_size, buffer_size)
+            != info->stored_size) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            return -1;
+        }
+        fseeko(archive, in_offset + info->stored_size, SEEK_SET);
+        fseeko(out, out_offset + info->stored_size, SEEK_SET);
+        return 0;
+    }
+    if (fread(src, 1, info->stored_size, archive) != info->stored_size || sa_internal_decode_chunk(info, src, dst) != 0) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+    if (fwrite(dst, 1, info->original_size, out) != info->original_size) {
+        perror("fwrite"); // Ошибка записи восстановленного файла
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для распаковки записи CHUNKED_FILE_ENTRY: блоки читаются и декодируются по одному,
+// поэтому память ограничена размером блока независимо от размера файла
+static int unpack_chunked_file(FILE *archive, FILE *out, size_t buffer_size) {
+    uint64_t original_size;
+    uint32_t chunk_size, chunk_count;
+    // Читаем размер файла, размер блока и число блоков
+    if (fread(&original_size, sizeof(uint64_t), 1, archive) != 1
+        || fread(&chunk_size, sizeof(uint32_t), 1, archive) != 1
+        || fread(&chunk_count, sizeof(uint32_t), 1, archive) != 1
+        || chunk_size == 0 || chunk_size > MAX_CHUNK_SIZE) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+
+    chunk_info_t *chunks = malloc((chunk_count ? chunk_count : 1) * sizeof(chunk_info_t));
+    uint8_t *src = malloc(2 * (size_t)chunk_size); // Закодированный блок (худший случай RLE)
+    uint8_t *dst = malloc(chunk_size);             // Восстановленный блок
+    int result = 0;
+    if (!chunks || !src || !dst) {
+        perror("malloc");
+        result = -1;
+    }
+
+    // Читаем таблицу блоков и проверяем, что размеры не выходят за пределы блока
+    for (uint32_t i = 0; result == 0 && i < chunk_count; i++) {
+        if (read_chunk_info(archive, &chunks[i]) != 0
+            || chunks[i].original_size > chunk_size || chunks[i].stored_size > 2 * (size_t)chunk_size) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            result = -1;
+        }
+    }
+
+    // Декодируем блоки по порядку
+    for (uint32_t i = 0; result == 0 && i < chunk_count; i++) {
+        result = unpack_chunk(archive, out, &chunks[i], src, dst, buffer_size);
+    }
+
+    free(chunks);
+    free(src);
+    free(dst);
+    return result;
+}
+
+// Функция для чтения описания очередного блока записи STREAMED_FILE_ENTRY.
+// Возвращает 1, если описан блок данных, 0 на завершающем нулевом описании и -1, если архив поврежден.
+static int read_streamed_chunk_info(FILE *archive, chunk_info_t *info) {
+    if (read_chunk_info(archive, info) != 0) return -1;
+    if (info->original_size == 0) return info->stored_size == 0 ? 0 : -1;
+    if (info->original_size > MAX_CHUNK_SIZE || info->stored_size > 2 * (size_t)info->original_size + 1) return -1;
+    return 1;
+}
+
+// Функция для распаковки записи STREAMED_FILE_ENTRY: описание каждого блока идет прямо перед
+// его данными, поэтому блоки декодируются по одному до завершающего нулевого описания
+static int unpack_streamed_file(FILE *archive, FILE *out, size_t buffer_size) {
+    uint8_t *src = NULL, *dst = NULL;
+    size_t src_capacity = 0, dst_capacity = 0;
+    chunk_info_t info;
+    int status, result = 0;
+    while (result == 0 && (status = read_streamed_chunk_info(archive, &info)) > 0) {
+        if (ensure_buffer(&src, &src_capacity, info.stored_size ? info.stored_size : 1) != 0
+            || ensure_buffer(&dst, &dst_capacity, info.original_size) != 0) {
+            result = -1;
+        } else {
+            result = unpack_chunk(archive, out, &info, src, dst, buffer_size);
+        }
+    }
+    if (result == 0 && status < 0) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        result = -1;
+    }
+    free(src);
+    free(dst);
+    return result;
+}
+
+// Функция для чтения заголовка записи: типа и относительного пути.
+// Возвращает 1, если заголовок прочитан, 0 в конце архива и -1, если архив поврежден.
+static int read_entry_header(FILE *archive, uint8_t *entry_type, char *relative_path) {
+    // Читаем тип записи (файл или директория)
+    if (fread(entry_type, sizeof(uint8_t), 1, archive) == 0) return 0; // Достигнут конец архива
+
+    uint16_t path_length;
+    // Читаем длину относительного пути и сам путь
+    if (fread(&path_length, sizeof(uint16_t), 1, archive) != 1 || path_length >= PATH_MAX
+        || fread(relative_path, sizeof(char), path_length, archive) != path_length) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+    relative_path[path_length] = '\0'; // Добавляем завершающий нулевой символ
+    return 1;
+}
+
+// Функция для восстановления данных файла записи FILE_ENTRY, CHUNKED_FILE_ENTRY или STREAMED_FILE_ENTRY в full_path.
+// Позиция архива должна стоять сразу за путем в заголовке записи.
+static int unpack_file_data(FILE *archive, uint8_t entry_type, const char *full_path, size_t buffer_size) {
+    FILE *out = fopen(full_path, "wb"); // Открываем файл для записи
+    if (!out) {
+        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть файл
+        return -1;
+    }
+
+    int result;
+    if (entry_type == FILE_ENTRY) { // Запись старого формата: один поток RLE
+        uint64_t original_size, compressed_size;
+        // Читаем оригинальный и сжатый размеры файла
+        if (fread(&original_size, sizeof(uint64_t), 1, archive) != 1
+            || fread(&compressed_size, sizeof(uint64_t), 1, archive) != 1) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            result = -1;
+        } else {
+            // Декодируем сжатые данные прямо из архива в выходной файл
+            result = rle_decode_file(archive, out, compressed_size, buffer_size);
+        }
+    } else if (entry_type == STREAMED_FILE_ENTRY) {
+        result = unpack_streamed_file(archive, out, buffer_size);
+    } else {
+        // Декодируем блоки по одному прямо из архива в выходной файл
+        result = unpack_chunked_file(archive, out, buffer_size);
+    }
+    fclose(out); // Закрываем выходной файл
+    return result;
+}
+
+// Функция для создания копии из уже восстановленной первой копии файла: жесткой ссылкой
+// (опция -hardlink) или копированием внутри ядра. На Btrfs и XFS copy_file_range разделяет
+// экстенты, как reflink, и копия не занимает места на диске.
+static int restore_from_original(const char *original_path, const char *full_path, uint64_t size, const sa_options_t *options) {
+    if (options->hardlink_duplicates) {
+        unlink(full_path); // link не заменяет существующий файл
+        if (link(original_path, full_path) == 0) return 0;
+    }
+
+    int in_fd = open(original_path, O_RDONLY);
+    if (in_fd < 0) return -1;
+    struct stat original_stat;
+    if (fstat(in_fd, &original_stat) != 0 || (uint64_t)original_stat.st_size != size) {
+        close(in_fd);
+        return -1; // Первой копии нет или она не та — декодируем из архива
+    }
+    int out_fd = open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        perror("open");
+        close(in_fd);
+        return -1;
+    }
+    int64_t copied = copy_range(in_fd, 0, out_fd, 0, size, options->buffer_size);
+    close(in_fd);
+    close(out_fd);
+    return copied == (int64_t)size ? 0 : -1;
+}
+
+// Функция для восстановления записи DUPLICATE_ENTRY. Если первые копии уже восстановлены
+// в output_folder (полная распаковка идет в порядке архива), копия делается из файла на диске;
+// иначе, например при извлечении одной записи, первая копия декодируется из архива заново.
+// Позиция архива остается на заголовке следующей записи.
+static int unpack_duplicate(FILE *archive, const char *output_folder, const char *full_path, int originals_restored,
+                            const sa_options_t *options) {
+    off_t entry_offset = ftello(archive);
+    uint64_t original_offset, size;
+    if (fread(&original_offset, sizeof(uint64_t), 1, archive) != 1
+        || fread(&size, sizeof(uint64_t), 1, archive) != 1 || original_offset >= (uint64_t)entry_offset) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+    off_t next_entry = ftello(archive);
+
+    // Читаем заголовок первой копии: копия всегда ссылается на запись с данными
+    uint8_t original_type;
+    char original_path[PATH_MAX];
+    int result = -1;
+    if (fseeko(archive, (off_t)original_offset, SEEK_SET) != 0
+        || read_entry_header(archive, &original_type, original_path) != 1
+        || (original_type != FILE_ENTRY && original_type != CHUNKED_FILE_ENTRY && original_type != STREAMED_FILE_ENTRY)) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+    } else {
+        if (originals_restored) {
+            char original_full_path[PATH_MAX];
+            if (snprintf(original_full_path, sizeof(original_full_path), "%s/%s", output_folder, original_path)
+                < (int)sizeof(original_full_path)) {
+                result = restore_from_original(original_full_path, full_path, size, options);
+            }
+        }
+        if (result != 0) result = unpack_file_data(archive, original_type, full_path, options->buffer_size);
+    }
+    fseeko(archive, next_entry, SEEK_SET);
+    return result;
+}
+
+// Функция для проверки, что путь совпадает с префиксом или лежит внутри него как в директории
+static int path_in_prefix(const char *path, const char *prefix, size_t prefix_length) {
+    return strncmp(path, prefix, prefix_length) == 0 && (path[prefix_length] == '\0' || path[prefix_length] == '/');
+}
+
+// Функция для восстановления файлов сплошного блока: блок декодируется один раз и делится
+// на файлы по таблице. Если prefix не NULL, восстанавливаются только файлы внутри prefix.
+// Позиция архива должна стоять сразу за путем в заголовке записи и остается за данными блока.
+static int unpack_solid_block(FILE *archive, const char *output_folder, const char *prefix, size_t prefix_length) {
+    uint32_t count;
+    if (fread(&count, sizeof(uint32_t), 1, archive) != 1 || count > SOLID_MAX_MEMBERS) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+
+    solid_member_t *members = calloc(count ? count : 1, sizeof(solid_member_t));
+    if (!members) {
+        perror("calloc");
+        return -1;
+    }
+
+    // Читаем таблицу файлов блока
+    int result = 0;
+    uint64_t total = 0;
+    for (uint32_t i = 0; result == 0 && i < count; i++) {
+        uint16_t path_length;
+        char path[PATH_MAX];
+        if (fread(&path_length, sizeof(uint16_t), 1, archive) != 1 || path_length >= PATH_MAX
+            || fread(path, sizeof(char), path_length, archive) != path_length
+            || fread(&members[i].size, sizeof(uint32_t), 1, archive) != 1
+            || fread(&members[i].mtime, sizeof(int64_t), 1, archive) != 1) {
+            result = -1;
+            break;
+        }
+        path[path_length] = '\0';
+        members[i].relative_path = strdup(path);
+        total += members[i].size;
+    }
+
+    // Описание закодированного блока: его исходный размер равен сумме размеров файлов
+    chunk_info_t info;
+    uint8_t *src = NULL, *dst = NULL;
+    if (result == 0 && (read_chunk_info(archive, &info) != 0 || info.original_size != total
+                        || info.original_size > MAX_CHUNK_SIZE || info.stored_size > 2 * (size_t)info.original_size + 1)) {
+        result = -1;
+    }
+    if (result == 0) {
+        src = malloc(info.stored_size ? info.stored_size : 1);
+        dst = malloc(info.original_size ? info.original_size : 1);
+        if (!src || !dst) {
+            perror("malloc");
+            result = -1;
+        } else if (fread(src, 1, info.stored_size, archive) != info.stored_size || sa_internal_decode_chunk(&info, src, dst) != 0) {
+            result = -1;
+        }
+    }
+    if (result != 0) fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+
+    // Делим восстановленный блок на файлы
+    uint64_t offset = 0;
+    for (uint32_t i = 0; result == 0 && i < count; i++) {
+        const solid_member_t *member = &members[i];
+        if (!member->relative_path) {
+            perror("strdup");
+            result = -1;
+            break;
+        }
+        if (!prefix || path_in_prefix(member->relative_path, prefix, prefix_length)) {
+            char full_path[PATH_MAX];
+            int fd = -1;
+            if (snprintf(full_path, sizeof(full_path), "%s/%s", output_folder, member->relative_path) >= (int)sizeof(full_path)) {
+                fprintf(stderr, "Ошибка: слишком длинный путь %s/%s\n", output_folder, member->relative_path);
+                result = -1;
+            } else if ((fd = open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                perror("open");
+                result = -1;
+            } else {
+                result = sa_internal_write_at(fd, dst + offset, member->size, 0);
+                close(fd);
+            }
+        }
+        offset += member->size;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        free(members[i].relative_path);
+    }
+    free(members);
+    free(src);
+    free(dst);
+    return result;
+}
+
+// Функция для восстановления одной записи, заголовок которой начинается с текущей позиции архива.
+// originals_restored сообщает, что все предшествующие записи уже восстановлены в output_folder.
+// Возвращает 0 при успехе и -1, если дальше читать архив нельзя.
+static int unpack_entry(FILE *archive, const char *output_folder, int originals_restored, const sa_options_t *options) {
+    uint8_t entry_type;
+    char relative_path[PATH_MAX];
+    if (read_entry_header(archive, &entry_type, relative_path) != 1) return -1;
+
+    char full_path[PATH_MAX];
+    // Формируем полный путь к файлу или директории в выходной директории
+    if (snprintf(full_path, sizeof(full_path), "%s/%s", output_folder, relative_path) >= (int)sizeof(full_path)) {
+        fprintf(stderr, "Ошибка: слишком длинный путь %s/%s\n", output_folder, relative_path); // Усеченный путь указал бы на другой файл
+        return -1;
+    }
+
+    if (entry_type == DIRECTORY_ENTRY) { // Если запись является директорией
+        sa_internal_create_directory(full_path); // Создаем директорию
+        return 0;
+    }
+    if (entry_type == DUPLICATE_ENTRY) { // Копия файла, записанного раньше
+        return unpack_duplicate(archive, output_folder, full_path, originals_restored, options);
+    }
+    if (entry_type == SOLID_BLOCK_ENTRY) { // Сплошной блок мелких файлов
+        return unpack_solid_block(archive, output_folder, NULL, 0);
+    }
+    if (entry_type != FILE_ENTRY && entry_type != CHUNKED_FILE_ENTRY && entry_type != STREAMED_FILE_ENTRY) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n"); // Неизвестный тип записи
+        return -1;
+    }
+    return unpack_file_data(archive, entry_type, full_path, options->buffer_size);
+}
+
+// Функция для пропуска данных записи при обходе архива без каталога.
+// Заполняет размеры записи и оставляет позицию на заголовке следующей записи.
+static int skip_entry_payload(FILE *archive, index_entry_t *entry) {
+    if (entry->entry_type == DIRECTORY_ENTRY) return 0; // У директории нет данных
+
+    if (entry->entry_type == SOLID_BLOCK_ENTRY) { // Пропускаем таблицу файлов, затем данные блока
+        uint32_t count;
+        chunk_info_t info;
+        if (fread(&count, sizeof(uint32_t), 1, archive) != 1) return -1;
+        for (uint32_t i = 0; i < count; i++) {
+            uint16_t path_length;
+            if (fread(&path_length, sizeof(uint16_t), 1, archive) != 1
+                || fseeko(archive, path_length + sizeof(uint32_t) + sizeof(int64_t), SEEK_CUR) != 0) return -1;
+        }
+        if (read_chunk_info(archive, &info) != 0) return -1;
+        entry->original_size = info.original_size;
+        entry->stored_size = info.stored_size;
+        return fseeko(archive, info.stored_size, SEEK_CUR);
+    }
+
+    if (entry->entry_type == DUPLICATE_ENTRY) { // У копии только ссылка на первую копию и размер
+        uint64_t original_offset;
+        if (fread(&original_offset, sizeof(uint64_t), 1, archive) != 1
+            || fread(&entry->original_size, sizeof(uint64_t), 1, archive) != 1) return -1;
+        return 0;
+    }
+
+    if (entry->entry_type == FILE_ENTRY) {
+        if (fread(&entry->original_size, sizeof(uint64_t), 1, archive) != 1
+            || fread(&entry->stored_size, sizeof(uint64_t), 1, archive) != 1) return -1;
+        return fseeko(archive, entry->stored_size, SEEK_CUR);
+    }
+
+    if (entry->entry_type == CHUNKED_FILE_ENTRY) {
+        uint32_t chunk_size, chunk_count;
+        if (fread(&entry->original_size, sizeof(uint64_t), 1, archive) != 1
+            || fread(&chunk_size, sizeof(uint32_t), 1, archive) != 1
+            || fread(&chunk_count, sizeof(uint32_t), 1, archive) != 1) return -1;
+        // Суммируем размеры блоков по таблице, сами блоки не читаем
+        for (uint32_t i = 0; i < chunk_count; i++) {
+            chunk_info_t info;
+            if (read_chunk_info(archive, &info) != 0) return -1;
+            entry->stored_size += info.stored_size;
+        }
+        return fseeko(archive, entry->stored_size, SEEK_CUR);
+    }
+
+    if (entry->entry_type == STREAMED_FILE_ENTRY) { // Идем по описаниям блоков, пропуская данные
+        chunk_info_t info;
+        int status;
+        while ((status = read_streamed_chunk_info(archive, &info)) > 0) {
+            entry->original_size += info.original_size;
+            entry->stored_size += info.stored_size;
+            if (fseeko(archive, info.stored_size, SEEK_CUR) != 0) return -1;
+        }
+        return status;
+    }
+    return -1; // Неизвестный тип записи
+}
+
+// Функция для добавления записи в каталог, прочитанный из архива
+static index_entry_t *index_append(archive_index_t *index) {
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        index_entry_t *entries = realloc(index->entries, capacity * sizeof(index_entry_t));
+        if (!entries) {
+            perror("realloc");
+            return NULL;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    index_entry_t *entry = &index->entries[index->count++];
+    memset(entry, 0, sizeof(*entry));
+    return entry;
+}
+
+// Функция для чтения центрального каталога по завершающему блоку.
+// Возвращает 1, если каталог прочитан, 0, если в архиве нет каталога, -1, если каталог поврежден,
+// и -2, если под каталог не хватило памяти.
+static int read_central_directory(FILE *archive, archive_index_t *index) {
+    if (fseeko(archive, 0, SEEK_END) != 0) return 0;
+    off_t archive_size = ftello(archive);
+    if (archive_size < INDEX_TRAILER_SIZE) return 0;
+
+    uint64_t directory_offset, entry_count;
+    uint32_t version;
+    char magic[4];
+    // Читаем завершающий блок с конца архива
+    fseeko(archive, archive_size - INDEX_TRAILER_SIZE, SEEK_SET);
+    if (fread(&directory_offset, sizeof(uint64_t), 1, archive) != 1
+        || fread(&entry_count, sizeof(uint64_t), 1, archive) != 1
+        || fread(&version, sizeof(uint32_t), 1, archive) != 1
+        || fread(magic, sizeof(char), 4, archive) != 4
+        || memcmp(magic, INDEX_MAGIC, 4) != 0) {
+        return 0; // Архив старого формата без каталога
+    }
+    // Неизвестная версия или смещение за пределами архива: сигнатура совпала случайно
+    // в конце архива старого формата, и он читается обходом записей
+    if ((version != INDEX_VERSION && version != INDEX_VERSION_NO_HASH) || directory_offset > (uint64_t)(archive_size - INDEX_TRAILER_SIZE)) {
+        return 0;
+    }
+
+    fseeko(archive, directory_offset, SEEK_SET);
+    for (uint64_t i = 0; i < entry_count; i++) {
+        index_entry_t *entry = index_append(index);
+        uint16_t path_length;
+        char path[PATH_MAX];
+        if (!entry) return -2; // Не хватило памяти под каталог
+        if (fread(&entry->entry_type, sizeof(uint8_t), 1, archive) != 1
+            || fread(&path_length, sizeof(uint16_t), 1, archive) != 1 || path_length >= PATH_MAX
+            || fread(path, sizeof(char), path_length, archive) != path_length
+            || fread(&entry->offset, sizeof(uint64_t), 1, archive) != 1
+            || fread(&entry->original_size, sizeof(uint64_t), 1, archive) != 1
+            || fread(&entry->stored_size, sizeof(uint64_t), 1, archive) != 1
+            || fread(&entry->mtime, sizeof(int64_t), 1, archive) != 1
+            || (version != INDEX_VERSION_NO_HASH && fread(&entry->hash, sizeof(uint64_t), 1, archive) != 1)
+            || entry->offset >= directory_offset) {
+            return -1;
+        }
+        path[path_length] = '\0';
+        if (!(entry->path = strdup(path))) {
+            perror("strdup");
+            return -2;
+        }
+    }
+    index->data_end = directory_offset; // Записи заканчиваются там, где начинается каталог
+    return 1;
+}
+
+// Функция для получения каталога архива. Новые архивы хранят каталог в конце,
+// и его чтение не зависит от объема данных; для архивов без каталога он строится
+// обходом заголовков записей с пропуском их данных.
+static int read_index(FILE *archive, archive_index_t *index) {
+    memset(index, 0, sizeof(*index));
+
+    int found = read_central_directory(archive, index);
+    if (found != 0) {
+        if (found == -1) fprintf(stderr, "Ошибка: центральный каталог архива поврежден\n");
+        if (found < 0) free_index(index);
+        return found < 0 ? -1 : 0;
+    }
+
+    // Каталога нет: проходим архив от начала до конца
+    fseeko(archive, 0, SEEK_SET);
+    while (1) {
+        off_t offset = ftello(archive);
+        uint8_t entry_type;
+        char path[PATH_MAX];
+        int status = read_entry_header(archive, &entry_type, path);
+        if (status == 0) break; // Конец архива
+        index_entry_t *entry = status > 0 ? index_append(index) : NULL;
+        if (!entry) {
+            free_index(index);
+            return -1;
+        }
+        entry->entry_type = entry_type;
+        entry->offset = offset;
+        if (!(entry->path = strdup(path))) {
+            perror("strdup");
+            free_index(index);
+            return -1;
+        }
+        if (skip_entry_payload(archive, entry) != 0) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            free_index(index);
+            return -1;
+        }
+    }
+    index->data_end = ftello(archive);
+    return 0;
+}
+
+// Функция для освобождения центрального каталога
+static void free_index(archive_index_t *index) {
+    for (size_t i = 0; i < index->count; i++) {
+        free(index->entries[i].path);
+    }
+    free(index->entries);
+    memset(index, 0, sizeof(*index));
+}
+
+// Функция для вывода содержимого архива в out: тип, исходный размер, размер в архиве, время изменения и путь
+int sa_list(const char *archive_path, FILE *out) {
+    char *archive_buffer = NULL;
+    FILE *archive = open_archive(archive_path, "rb", DEFAULT_BUFFER_SIZE, &archive_buffer); // Открываем архив для чтения в бинарном режиме
+    if (!archive) {
+        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
+        return -1;
+    }
+
+    archive_index_t index;
+    int result = read_index(archive, &index);
+    if (result == 0) {
+        fprintf(out, "Тип       Размер      В архиве  Изменен           Путь\n");
+        for (size_t i = 0; i < index.count; i++) {
+            const index_entry_t *entry = &index.entries[i];
+            char date[32] = "-";
+            time_t mtime = (time_t)entry->mtime;
+            if (entry->mtime != 0) { // В архивах без каталога время изменения неизвестно
+                strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&mtime));
+            }
+            fprintf(out, "%-4s %11llu %13llu  %-16s  %s\n",
+                    entry->entry_type == DIRECTORY_ENTRY ? "dir" : entry->entry_type == DUPLICATE_ENTRY ? "dup"
+                    : entry->entry_type == SOLID_BLOCK_ENTRY ? "blk" : "file",
+                    (unsigned long long)entry->original_size, (unsigned long long)entry->stored_size,
+                    date, entry->entry_type == SOLID_BLOCK_ENTRY ? "-" : entry->path);
+        }
+        free_index(&index);
+    }
+
+    fclose(archive);      // Закрываем архив
+    free(archive_buffer); // Освобождаем буфер архива
+    return result;
+}
+
+// Функция для создания всех родительских директорий пути (аналог mkdir -p для dirname)
+static int create_parent_directories(const char *path) {
+    char buffer[PATH_MAX];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+    for (char *slash = strchr(buffer + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (sa_internal_create_directory(buffer) != 0) return -1;
+        *slash = '/';
+    }
+    return 0;
+}
+
+// Функция для извлечения одной записи (или директории со всем содержимым) по пути в архиве.
+// Нужные записи находятся по каталогу, поэтому читаются только их заголовки и данные.
+int sa_extract(const char *archive_path, const char *entry_path, const char *output_folder, const sa_options_t *options) {
+    sa_options_t resolved;
+    resolve_options(options, &resolved);
+
+    char *archive_buffer = NULL;
+    FILE *archive = open_archive(archive_path, "rb", resolved.buffer_size, &archive_buffer); // Открываем архив для чтения в бинарном режиме
+    if (!archive) {
+        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
+        return -1;
+    }
+
+    archive_index_t index;
+    if (read_index(archive, &index) != 0) {
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+
+    size_t prefix_length = strlen(entry_path);
+    while (prefix_length > 1 && entry_path[prefix_length - 1] == '/') prefix_length--; // Игнорируем завершающий '/'
+
+    size_t extracted = 0;
+    int result = 0;
+    uint64_t solid_offset = UINT64_MAX; // Последний уже обработанный сплошной блок
+    for (size_t i = 0; i < index.count; i++) {
+        const index_entry_t *entry = &index.entries[i];
+        // Подходит сама запись и все записи внутри нее, если это директория
+        if (entry->entry_type == SOLID_BLOCK_ENTRY || !path_in_prefix(entry->path, entry_path, prefix_length)) {
+            continue;
+        }
+        if (entry->entry_type == SOLID_MEMBER_ENTRY && entry->offset == solid_offset) {
+            extracted++; // Файл уже восстановлен вместе с остальными подходящими файлами своего блока
+            continue;
+        }
+
+        char full_path[PATH_MAX];
+        if (snprintf(full_path, sizeof(full_path), "%s/%s", output_folder, entry->path) >= (int)sizeof(full_path)) {
+            fprintf(stderr, "Ошибка: слишком длинный путь %s/%s\n", output_folder, entry->path);
+            result = -1;
+            break;
+        }
+        if (extracted == 0 && create_parent_directories(full_path) != 0) { // Родители первой записи
+            result = -1;
+            break;
+        }
+
+        fseeko(archive, entry->offset, SEEK_SET); // Переходим прямо к заголовку записи
+        if (entry->entry_type == SOLID_MEMBER_ENTRY) {
+            // Блок декодируется один раз, из него берутся все файлы внутри извлекаемого пути
+            uint8_t entry_type;
+            char block_path[PATH_MAX];
+            solid_offset = entry->offset;
+            if (read_entry_header(archive, &entry_type, block_path) != 1 || entry_type != SOLID_BLOCK_ENTRY
+                || unpack_solid_block(archive, output_folder, entry_path, prefix_length) != 0) {
+                result = -1;
+                break;
+            }
+        } else if (unpack_entry(archive, output_folder, 0, &resolved) != 0) {
+            result = -1;
+            break;
+        }
+        extracted++;
+    }
+
+    if (extracted == 0 && result == 0) {
+        fprintf(stderr, "Ошибка: в архиве нет записи %s\n", entry_path);
+        result = -1;
+    }
+
+    free_index(&index);
+    fclose(archive);      // Закрываем архив
+    free(archive_buffer); // Освобождаем буфер архива
+    return result;
+}
+
+// Функция для предвыделения места под восстанавливаемый файл известного размера
+static void preallocate_file(int fd, uint64_t size) {
+    if (size == 0) return;
+#ifdef __linux__
+    // fallocate резервирует экстенты сразу, и последующие записи не фрагментируют файл
+    if (fallocate(fd, 0, 0, (off_t)size) == 0) return;
+#endif
+    // Файловая система не поддерживает fallocate: просто задаем итоговый размер
+    if (ftruncate(fd, (off_t)size) != 0) perror("ftruncate");
+}
+
+// Функция для увеличения рабочего буфера потока до нужного размера
+static int ensure_buffer(uint8_t **buffer, size_t *capacity, size_t size) {
+    if (*capacity >= size) return 0;
+    uint8_t *grown = realloc(*buffer, size);
+    if (!grown) {
+        perror("realloc");
+        return -1;
+    }
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
+
+// Рабочие буферы потока распаковки
+typedef struct {
+    uint8_t *src;      // Закодированный блок
+    size_t src_size;
+    uint8_t *dst;      // Восстановленный блок
+    size_t dst_size;
+    FILE *archive;     // Собственный поток архива для записей старого формата
+} unpack_buffers_t;
+
+// Функция для чтения, декодирования и записи одного блока по смещению в выходном файле.
+// Блок без сжатия копируется из архива в выходной файл внутри ядра, остальные декодируются
+// прямо из отображения архива, а без отображения — после чтения через pread.
+static int unpack_chunk_at(const unpack_pool_t *pool, int out_fd, const chunk_info_t *info, uint64_t data_offset,
+                           uint64_t out_offset, unpack_buffers_t *buffers) {
+    if (info->codec == CODEC_STORED) {
+        if (info->stored_size != info->original_size
+            || copy_range(pool->fd, data_offset, out_fd, out_offset, info->stored_size, pool->options->buffer_size)
+               != info->stored_size) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (ensure_buffer(&buffers->dst, &buffers->dst_size, info->original_size ? info->original_size : 1) != 0) {
+        return -1;
+    }
+    const uint8_t *src = NULL;
+    if (pool->map && data_offset <= pool->map_size && info->stored_size <= pool->map_size - data_offset) {
+        src = pool->map + data_offset;
+    } else if (ensure_buffer(&buffers->src, &buffers->src_size, info->stored_size ? info->stored_size : 1) != 0) {
+        return -1;
+    } else if (sa_internal_read_chunk(pool->fd, buffers->src, info->stored_size, data_offset) == info->stored_size) {
+        src = buffers->src;
+    }
+    if (!src || sa_internal_decode_chunk(info, src, buffers->dst) != 0) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+    return sa_internal_write_at(out_fd, buffers->dst, info->original_size, out_offset);
+}
+
+// Функция для выполнения одного задания распаковки
+static int unpack_run_task(unpack_pool_t *pool, const unpack_task_t *task, unpack_buffers_t *buffers) {
+    const index_entry_t *entry = &pool->index->entries[task->entry];
+    char full_path[PATH_MAX];
+    if (snprintf(full_path, sizeof(full_path), "%s/%s", pool->output_folder, entry->path) >= (int)sizeof(full_path)) {
+        fprintf(stderr, "Ошибка: слишком длинный путь %s/%s\n", pool->output_folder, entry->path);
+        return -1;
+    }
+
+    // Запись старого формата (один поток RLE), сплошной блок и файл без таблицы блоков
+    // читаются последовательно через свой FILE
+    if (entry->entry_type == FILE_ENTRY || entry->entry_type == SOLID_BLOCK_ENTRY || entry->entry_type == STREAMED_FILE_ENTRY) {
+        if (!buffers->archive && !(buffers->archive = fopen(pool->archive_path, "rb"))) {
+            perror("fopen");
+            return -1;
+        }
+        fseeko(buffers->archive, entry->offset, SEEK_SET);
+        return unpack_entry(buffers->archive, pool->output_folder, 1, pool->options);
+    }
+
+    if (!task->whole_entry) { // Один блок большого файла: файл создают и дописывают все его задания
+        int fd = open(full_path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror("open");
+            return -1;
+        }
+        if (task->chunk_index == 0) { // Итоговый размер задает задание первого блока
+            if (ftruncate(fd, (off_t)task->file_size) != 0) perror("ftruncate");
+            preallocate_file(fd, task->file_size);
+        }
+        int result = unpack_chunk_at(pool, fd, &task->info, task->data_offset, task->out_offset, buffers);
+        close(fd);
+        return result;
+    }
+
+    chunked_header_t header;
+    if (read_chunked_header(pool->fd, entry->offset, &header) != 0) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+
+    int result = 0;
+    int fd = open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        result = -1;
+    } else {
+        preallocate_file(fd, header.original_size);
+        uint64_t data_offset = header.data_offset, out_offset = 0;
+        for (uint32_t i = 0; result == 0 && i < header.chunk_count; i++) {
+            result = unpack_chunk_at(pool, fd, &header.chunks[i], data_offset, out_offset, buffers);
+            data_offset += header.chunks[i].stored_size;
+            out_offset += header.chunks[i].original_size;
+        }
+        close(fd);
+    }
+    free(header.chunks);
+    return result;
+}
+
+// Функция рабочего потока распаковки: берет задания по одному, пока они не кончатся
+static void *unpack_worker(void *arg) {
+    unpack_pool_t *pool = arg;
+    unpack_buffers_t buffers;
+    memset(&buffers, 0, sizeof(buffers));
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        size_t task = pool->next_task < pool->task_count ? pool->next_task++ : pool->task_count;
+        pthread_mutex_unlock(&pool->lock);
+        if (task == pool->task_count) break; // Заданий больше нет
+
+        if (unpack_run_task(pool, &pool->tasks[task], &buffers) != 0) {
+            pthread_mutex_lock(&pool->lock);
+            pool->failed = 1;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+    free(buffers.src);
+    free(buffers.dst);
+    if (buffers.archive) fclose(buffers.archive);
+    return NULL;
+}
+
+// Функция для добавления задания распаковки
+static int add_unpack_task(unpack_task_t **tasks, size_t *count, size_t *capacity, const unpack_task_t *task) {
+    if (*count == *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+        unpack_task_t *grown = realloc(*tasks, grown_capacity * sizeof(unpack_task_t));
+        if (!grown) {
+            perror("realloc");
+            return -1;
+        }
+        *tasks = grown;
+        *capacity = grown_capacity;
+    }
+    (*tasks)[(*count)++] = *task;
+    return 0;
+}
+
+// Функция для параллельной разархивации по каталогу архива.
+// Сначала создаются все директории, затем записи файлов раздаются рабочим потокам,
+// которые читают архив через pread независимо друг от друга. Файлы больше одного блока
+// делятся на задания по блокам, чтобы один большой файл восстанавливали все потоки.
+static int unpack_parallel(FILE *archive, const char *archive_path, const char *output_folder, const sa_options_t *options) {
+    archive_index_t index;
+    if (read_index(archive, &index) != 0) return -1;
+
+    int threads = options->threads;
+    unpack_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.archive_path = archive_path;
+    pool.options = options;
+    pool.fd = fileno(archive);
+    pool.output_folder = output_folder;
+    pool.index = &index;
+
+    // Архив отображается в память целиком: рабочие потоки декодируют блоки прямо из него
+    struct stat archive_stat;
+    if (fstat(pool.fd, &archive_stat) == 0) {
+        pool.map_size = archive_stat.st_size;
+        pool.map = map_file(pool.fd, pool.map_size);
+    }
+
+    size_t capacity = 0;
+    int result = 0;
+    for (size_t i = 0; result == 0 && i < index.count; i++) {
+        const index_entry_t *entry = &index.entries[i];
+        char full_path[PATH_MAX];
+        if (snprintf(full_path, sizeof(full_path), "%s/%s", output_folder, entry->path) >= (int)sizeof(full_path)) {
+            fprintf(stderr, "Ошибка: слишком длинный путь %s/%s\n", output_folder, entry->path);
+            result = -1;
+            break;
+        }
+
+        if (entry->entry_type == DIRECTORY_ENTRY) { // Директории создаем заранее в порядке обхода
+            sa_internal_create_directory(full_path);
+            continue;
+        }
+        if (entry->entry_type == DUPLICATE_ENTRY) continue; // Копии восстанавливаются после первых копий
+        if (entry->entry_type == SOLID_MEMBER_ENTRY) continue; // Файлы восстанавливаются заданием своего блока
+
+        unpack_task_t task;
+        memset(&task, 0, sizeof(task));
+        task.entry = i;
+        task.whole_entry = 1;
+        if (entry->entry_type != CHUNKED_FILE_ENTRY || entry->original_size <= CHUNK_SIZE) {
+            result = add_unpack_task(&pool.tasks, &pool.task_count, &capacity, &task);
+            continue;
+        }
+
+        // Большой файл: читаем таблицу блоков и заводим задание на каждый блок
+        chunked_header_t header;
+        if (read_chunked_header(pool.fd, entry->offset, &header) != 0) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            result = -1;
+            break;
+        }
+        task.whole_entry = 0;
+        task.file_size = header.original_size;
+        task.data_offset = header.data_offset;
+        for (uint32_t c = 0; result == 0 && c < header.chunk_count; c++) {
+            task.chunk_index = c;
+            task.info = header.chunks[c];
+            result = add_unpack_task(&pool.tasks, &pool.task_count, &capacity, &task);
+            task.data_offset += header.chunks[c].stored_size;
+            task.out_offset += header.chunks[c].original_size;
+        }
+        free(header.chunks);
+    }
+
+    if (result == 0) {
+        sa_internal_rle_init_kernels(); // Выбираем ядра до запуска потоков
+        pthread_t *workers = calloc(threads, sizeof(pthread_t));
+        pthread_mutex_init(&pool.lock, NULL);
+        int started = 0;
+        for (; workers && started < threads; started++) {
+            if (pthread_create(&workers[started], NULL, unpack_worker, &pool) != 0) break;
+        }
+        if (started == 0) unpack_worker(&pool); // Потоки создать не удалось — распаковываем сами
+        for (int i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        pthread_mutex_destroy(&pool.lock);
+        free(workers);
+        result = pool.failed ? -1 : 0;
+    }
+
+    // Все первые копии восстановлены: копии делаются из них ссылками или копированием внутри ядра
+    for (size_t i = 0; result == 0 && i < index.count; i++) {
+        if (index.entries[i].entry_type != DUPLICATE_ENTRY) continue;
+        fseeko(archive, index.entries[i].offset, SEEK_SET);
+        result = unpack_entry(archive, output_folder, 1, options);
+    }
+
+    unmap_file(pool.map, pool.map_size);
+    free(pool.tasks);
+    free_index(&index);
+    return result;
+}
+
+// Функция для разархивации архива в указанную директорию
+int sa_unpack(const char *archive_path, const char *output_folder, const sa_options_t *options) {
+    sa_options_t resolved;
+    resolve_options(options, &resolved);
+
+    char *archive_buffer = NULL;
+    FILE *archive = open_archive(archive_path, "rb", resolved.buffer_size, &archive_buffer); // Открываем архив для чтения в бинарном режиме
+    if (!archive) {
+        perror("fopen"); // Выводим сообщение об ошибке, если не удалось открыть архив
+        return -1;
+    }
+
+    // Создаем выходную директорию, если она не существует
+    if (sa_internal_create_directory(output_folder) != 0) {
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+
+    int result = 0;
+    if (resolved.threads > 1) { // Восстанавливаем записи несколькими потоками по каталогу
+        result = unpack_parallel(archive, archive_path, output_folder, &resolved);
+        fclose(archive);
+        free(archive_buffer);
+        return result;
+    }
+
+    // Записи заканчиваются перед центральным каталогом, а в старых архивах — в конце файла
+    archive_index_t index;
+    memset(&index, 0, sizeof(index));
+    int found = read_central_directory(archive, &index);
+    fseeko(archive, 0, SEEK_END);
+    off_t data_end = found > 0 ? (off_t)index.data_end : ftello(archive);
+    free_index(&index);
+    if (found == -2) { // Без границы данных каталог был бы прочитан как записи
+        fclose(archive);
+        free(archive_buffer);
+        return -1;
+    }
+    fseeko(archive, 0, SEEK_SET);
+
+    // Читаем записи из архива и восстанавливаем файлы и директории
+    while (ftello(archive) < data_end) {
+        if (unpack_entry(archive, output_folder, 1, &resolved) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    fclose(archive);      // Закрываем архив
+    free(archive_buffer); // Освобождаем буфер архива
+    return result;
+}
+
+// Функция для чтения описания блока из таблицы в памяти
+static void load_chunk_info(const uint8_t *p, chunk_info_t *info) {
+    memcpy(&info->original_size, p, sizeof(uint32_t));
+    memcpy(&info->stored_size, p + 4, sizeof(uint32_t));
+    info->codec = p[8];
+}
+
+// Функция для записи описания блока в таблицу в памяти (в том же виде, что write_chunk_info)
+static void store_chunk_info(uint8_t *p, const chunk_info_t *info) {
+    memcpy(p, &info->original_size, sizeof(uint32_t));
+    memcpy(p + 4, &info->stored_size, sizeof(uint32_t));
+    p[8] = info->codec;
+}
+
+// Функция для разбора данных записи CHUNKED_FILE_ENTRY в памяти: заголовок и таблица блоков
+// проверяются по границам available байт, суммы размеров блоков — по заголовку
+static int parse_chunked_payload(const uint8_t *p, uint64_t available, chunked_view_t *view) {
+    if (available < CHUNKED_HEADER_SIZE) return -1;
+    memcpy(&view->original_size, p, sizeof(uint64_t));
+    memcpy(&view->chunk_size, p + 8, sizeof(uint32_t));
+    memcpy(&view->chunk_count, p + 12, sizeof(uint32_t));
+    if (view->chunk_size == 0 || view->chunk_size > MAX_CHUNK_SIZE) return -1;
+
+    uint64_t table_size = (uint64_t)view->chunk_count * CHUNK_INFO_SIZE;
+    if (available - CHUNKED_HEADER_SIZE < table_size) return -1;
+    view->table = p + CHUNKED_HEADER_SIZE;
+    view->data = view->table + table_size;
+
+    // Суммируем размеры блоков: данные должны поместиться в available
+    uint64_t original = 0, stored = 0;
+    view->all_stored = 1;
+    for (uint32_t i = 0; i < view->chunk_count; i++) {
+        chunk_info_t info;
+        load_chunk_info(view->table + (size_t)i * CHUNK_INFO_SIZE, &info);
+        if (info.original_size > view->chunk_size || info.stored_size > 2 * (uint64_t)view->chunk_size + 1) return -1;
+        if (info.codec != CODEC_STORED || info.stored_size != info.original_size) view->all_stored = 0;
+        original += info.original_size;
+        stored += info.stored_size;
+    }
+    if (original != view->original_size || stored > available - CHUNKED_HEADER_SIZE - table_size) return -1;
+    return 0;
+}
+
+// Функция для декодирования всех блоков разобранных данных в dst (view->original_size байт)
+static int decode_chunked_payload(const chunked_view_t *view, uint8_t *dst) {
+    const uint8_t *src = view->data;
+    for (uint32_t i = 0; i < view->chunk_count; i++) {
+        chunk_info_t info;
+        load_chunk_info(view->table + (size_t)i * CHUNK_INFO_SIZE, &info);
+        if (sa_internal_decode_chunk(&info, src, dst) != 0) return -1;
+        src += info.stored_size;
+        dst += info.original_size;
+    }
+    return 0;
+}
+
+// Функция для получения наибольшего размера результата sa_encode для size байт данных
+size_t sa_encode_bound(size_t size) {
+    size_t chunks = size / CHUNK_SIZE + (size % CHUNK_SIZE != 0);
+    return CHUNKED_HEADER_SIZE + chunks * CHUNK_INFO_SIZE + size;
+}
+
+// Функция для кодирования буфера в буфер. Формат — данные записи CHUNKED_FILE_ENTRY:
+// блоки по CHUNK_SIZE байт кодируются независимо, несжимаемые хранятся как есть.
+// Каждый блок кодируется прямо в dst, поэтому память не выделяется.
+size_t sa_encode(const void *src, size_t size, void *dst, size_t capacity, void *scratch) {
+    sa_internal_rle_init_kernels(); // PackBits ищет серии векторным ядром, как и при упаковке архива
+    const uint8_t *in = src;
+    uint8_t *out = dst;
+    uint64_t original_size = size;
+    uint32_t chunk_size = CHUNK_SIZE;
+    uint64_t chunks = size / CHUNK_SIZE + (size % CHUNK_SIZE != 0);
+    if (chunks > UINT32_MAX) return 0;
+    uint32_t chunk_count = (uint32_t)chunks;
+
+    size_t position = CHUNKED_HEADER_SIZE + (size_t)chunk_count * CHUNK_INFO_SIZE; // Данные идут за таблицей
+    if (capacity < position) return 0;
+    memcpy(out, &original_size, sizeof(uint64_t));
+    memcpy(out + 8, &chunk_size, sizeof(uint32_t));
+    memcpy(out + 12, &chunk_count, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        size_t offset = (size_t)i * CHUNK_SIZE;
+        size_t n = size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE;
+        if (capacity - position < n) return 0; // Блок может не сжаться: место нужно под исходный размер
+
+        chunk_info_t info;
+        if (sa_internal_encode_chunk(in + offset, n, out + position, &info, scratch) == 0) {
+            memcpy(out + position, in + offset, n); // Несжимаемый блок хранится как есть
+        }
+        store_chunk_info(out + CHUNKED_HEADER_SIZE + (size_t)i * CHUNK_INFO_SIZE, &info);
+        position += info.stored_size;
+    }
+    return position;
+}
+
+// Функция для чтения исходного размера закодированного буфера
+int sa_decoded_size(const void *src, size_t size, uint64_t *decoded_size) {
+    chunked_view_t view;
+    if (parse_chunked_payload(src, size, &view) != 0) {
+        fprintf(stderr, "Ошибка: закодированные данные повреждены или обрезаны\n");
+        return -1;
+    }
+    *decoded_size = view.original_size;
+    return 0;
+}
+
+// Функция для декодирования буфера, полученного sa_encode
+int sa_decode(const void *src, size_t size, void *dst, size_t capacity) {
+    chunked_view_t view;
+    if (parse_chunked_payload(src, size, &view) != 0 || view.original_size > capacity) {
+        fprintf(stderr, "Ошибка: закодированные данные повреждены или не помещаются в буфер\n");
+        return -1;
+    }
+    sa_internal_rle_init_kernels(); // Блоки прежнего формата декодируются ядрами RLE
+    if (decode_chunked_payload(&view, dst) != 0) {
+        fprintf(stderr, "Ошибка: закодированные данные повреждены\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для вычисления хеша данных так же, как хеш файла в каталоге архива: хеши блоков
+// по CHUNK_SIZE байт, затем хеш их массива. Хеши блоков накапливаются на стеке,
+// память выделяется только для данных больше HASH_STACK_CHUNKS блоков.
+uint64_t sa_hash(const void *data, size_t size) {
+    uint64_t stack_hashes[HASH_STACK_CHUNKS] = { 0 };
+    uint64_t chunks = size / CHUNK_SIZE + (size % CHUNK_SIZE != 0);
+    if (chunks > UINT32_MAX) return 0;
+    uint64_t *hashes = stack_hashes;
+    if (chunks > HASH_STACK_CHUNKS && !(hashes = malloc(chunks * sizeof(uint64_t)))) {
+        perror("malloc");
+        return 0; // Хеш неизвестен
+    }
+
+    for (uint64_t i = 0; i < chunks; i++) {
+        size_t offset = (size_t)i * CHUNK_SIZE;
+        size_t n = size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE;
+        hashes[i] = sa_internal_content_hash((const uint8_t *)data + offset, n, 0);
+    }
+    uint64_t hash = combine_chunk_hashes(hashes, (uint32_t)chunks, size);
+    if (hashes != stack_hashes) free(hashes);
+    return hash;
+}
+
+#ifdef __linux__
+// Функция вывода потока stdio писателя: передает данные функции записи вызывающего
+static ssize_t writer_cookie_write(void *cookie, const char *data, size_t size) {
+    sa_writer_t *writer = cookie;
+    if (writer->write(writer->context, data, size) != 0) return 0; // 0 — ошибка записи потока
+    writer->position += size;
+    return (ssize_t)size;
+}
+
+// Функция позиционирования потока писателя: вывод только дописывается,
+// поэтому поддерживается лишь запрос текущей позиции (для ftello)
+static int writer_cookie_seek(void *cookie, off64_t *offset, int whence) {
+    sa_writer_t *writer = cookie;
+    if ((whence == SEEK_CUR && *offset == 0) || (whence == SEEK_SET && (uint64_t)*offset == writer->position)) {
+        *offset = (off64_t)writer->position;
+        return 0;
+    }
+    errno = ESPIPE;
+    return -1;
+}
+#else
+// Функция вывода потока stdio писателя: передает данные функции записи вызывающего
+static int writer_cookie_write(void *cookie, const char *data, int size) {
+    sa_writer_t *writer = cookie;
+    if (writer->write(writer->context, data, (size_t)size) != 0) return -1;
+    writer->position += (uint64_t)size;
+    return size;
+}
+
+// Функция позиционирования потока писателя: поддерживается лишь запрос текущей позиции
+static fpos_t writer_cookie_seek(void *cookie, fpos_t offset, int whence) {
+    sa_writer_t *writer = cookie;
+    if ((whence == SEEK_CUR && offset == 0) || (whence == SEEK_SET && (uint64_t)offset == writer->position)) {
+        return (fpos_t)writer->position;
+    }
+    errno = ESPIPE;
+    return -1;
+}
+#endif
+
+// Функция для создания писателя без потока вывода
+static sa_writer_t *writer_create(void) {
+    sa_writer_t *writer = calloc(1, sizeof(sa_writer_t));
+    if (!writer) {
+        perror("calloc");
+        return NULL;
+    }
+    sa_options_init(&writer->options);
+    writer->options.content_hashing = 1; // Хеши файлов пишутся в каталог всегда: они считаются по ходу кодирования
+    writer->archive.options = &writer->options;
+    sa_internal_rle_init_kernels();
+    return writer;
+}
+
+// Функция для освобождения писателя (поток вывода должен быть уже закрыт)
+static void writer_free(sa_writer_t *writer) {
+    free_index(&writer->archive.index);
+    free(writer->memory);
+    free(writer->stream_buffer);
+    free(writer->dst);
+    free(writer->staging);
+    free(writer->chunks);
+    free(writer->hashes);
+    free(writer);
+}
+
+// Функция для открытия писателя, собирающего архив в памяти
+sa_writer_t *sa_writer_open_memory(void) {
+    sa_writer_t *writer = writer_create();
+    if (!writer) return NULL;
+    writer->archive.file = open_memstream(&writer->memory, &writer->memory_size);
+    if (!writer->archive.file) {
+        perror("open_memstream");
+        writer_free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+// Функция для открытия писателя, выводящего архив функцией write.
+// Поток stdio с большим буфером собирает мелкие заголовки в крупные вызовы write.
+sa_writer_t *sa_writer_open_callback(sa_write_fn write, void *context) {
+    sa_writer_t *writer = writer_create();
+    if (!writer) return NULL;
+    writer->write = write;
+    writer->context = context;
+#ifdef __linux__
+    cookie_io_functions_t functions = { NULL, writer_cookie_write, writer_cookie_seek, NULL };
+    writer->archive.file = fopencookie(writer, "w", functions);
+#else
+    writer->archive.file = funopen(writer, NULL, writer_cookie_write, writer_cookie_seek, NULL);
+#endif
+    if (!writer->archive.file) {
+        perror("fopencookie");
+        writer_free(writer);
+        return NULL;
+    }
+    writer->stream_buffer = malloc(writer->options.buffer_size);
+    if (writer->stream_buffer) {
+        setvbuf(writer->archive.file, writer->stream_buffer, _IOFBF, writer->options.buffer_size);
+    }
+    return writer;
+}
+
+// Функция для проверки, что писатель принимает записи и путь записи допустим
+static int writer_check(const sa_writer_t *writer, const char *path) {
+    if (writer->failed) {
+        fprintf(stderr, "Ошибка: предыдущая запись в архив не удалась\n");
+        return -1;
+    }
+    if (!path || path[0] == '\0' || strlen(path) >= PATH_MAX) {
+        fprintf(stderr, "Ошибка: недопустимый путь записи\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для проверки ошибок потока и каталога после вывода записи
+static int writer_status(sa_writer_t *writer) {
+    if (ferror(writer->archive.file) || writer->archive.failed) {
+        fprintf(stderr, "Ошибка: не удалось записать архив\n");
+        writer->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для подготовки места под описание блока с номером index
+static int writer_reserve_chunk(sa_writer_t *writer, size_t index) {
+    if (index < writer->chunk_capacity) return 0;
+    size_t capacity = writer->chunk_capacity ? writer->chunk_capacity * 2 : 64;
+    while (capacity <= index) capacity *= 2;
+    staged_chunk_t *chunks = realloc(writer->chunks, capacity * sizeof(staged_chunk_t));
+    if (chunks) writer->chunks = chunks;
+    uint64_t *hashes = realloc(writer->hashes, capacity * sizeof(uint64_t));
+    if (hashes) writer->hashes = hashes;
+    if (!chunks || !hashes) {
+        perror("realloc");
+        return -1;
+    }
+    writer->chunk_capacity = capacity;
+    return 0;
+}
+
+// Функция для подготовки места в staging под len байт после used
+static int writer_reserve_staging(sa_writer_t *writer, size_t used, size_t len) {
+    if (writer->staging_capacity - used >= len) return 0;
+    size_t capacity = writer->staging_capacity ? writer->staging_capacity : CHUNK_SIZE;
+    while (capacity - used < len) capacity *= 2;
+    return ensure_buffer(&writer->staging, &writer->staging_capacity, capacity);
+}
+
+// Функция для вывода собранной записи CHUNKED_FILE_ENTRY: заголовок, таблица блоков, блоки.
+// Несжатые блоки буферной записи берутся прямо из source, остальные — из staging.
+static int writer_emit_file(sa_writer_t *writer, const char *path, int64_t mtime, uint64_t size, const uint8_t *source, uint32_t count) {
+    FILE *archive = writer->archive.file;
+    uint32_t chunk_size = CHUNK_SIZE;
+    uint64_t stored_size = 0;
+
+    size_t slot = write_entry_header(&writer->archive, CHUNKED_FILE_ENTRY, path, mtime);
+    fwrite(&size, sizeof(uint64_t), 1, archive);        // Оригинальный размер файла
+    fwrite(&chunk_size, sizeof(uint32_t), 1, archive);  // Размер блока
+    fwrite(&count, sizeof(uint32_t), 1, archive);       // Число блоков
+    for (uint32_t i = 0; i < count; i++) {
+        write_chunk_info(archive, &writer->chunks[i].info);
+        stored_size += writer->chunks[i].info.stored_size;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const staged_chunk_t *chunk = &writer->chunks[i];
+        const uint8_t *data = chunk->staged == SIZE_MAX ? source + (size_t)i * CHUNK_SIZE : writer->staging + chunk->staged;
+        fwrite(data, 1, chunk->info.stored_size, archive);
+    }
+
+    if (slot != SIZE_MAX) {
+        index_entry_t *entry = &writer->archive.index.entries[slot];
+        entry->original_size = size;
+        entry->stored_size = stored_size;
+        entry->hash = combine_chunk_hashes(writer->hashes, count, size);
+    }
+    return writer_status(writer);
+}
+
+// Функция для добавления директории
+int sa_writer_add_directory(sa_writer_t *writer, const char *path, int64_t mtime) {
+    if (writer_check(writer, path) != 0) return -1;
+    write_entry_header(&writer->archive, DIRECTORY_ENTRY, path, mtime);
+    return writer_status(writer);
+}
+
+// Функция для добавления файла из буфера. Сжатые блоки собираются в staging,
+// несжатые выводятся прямо из data без копирования.
+int sa_writer_add_buffer(sa_writer_t *writer, const char *path, int64_t mtime, const void *data, size_t size) {
+    if (writer_check(writer, path) != 0) return -1;
+    uint64_t chunks = size / CHUNK_SIZE + (size % CHUNK_SIZE != 0);
+    if (chunks > UINT32_MAX || writer_reserve_chunk(writer, chunks ? chunks - 1 : 0) != 0) return -1;
+
+    size_t staged = 0;
+    for (uint32_t i = 0; i < chunks; i++) {
+        const uint8_t *src = (const uint8_t *)data + (size_t)i * CHUNK_SIZE;
+        size_t n = size - (size_t)i * CHUNK_SIZE < CHUNK_SIZE ? size - (size_t)i * CHUNK_SIZE : CHUNK_SIZE;
+        staged_chunk_t *chunk = &writer->chunks[i];
+        if (writer_reserve_staging(writer, staged, n) != 0) return -1;
+
+        writer->hashes[i] = sa_internal_content_hash(src, n, 0);
+        chunk->staged = SIZE_MAX;
+        if (sa_internal_encode_chunk(src, n, writer->staging + staged, &chunk->info, &writer->scratch) > 0) {
+            chunk->staged = staged;
+            staged += chunk->info.stored_size;
+        }
+    }
+    return writer_emit_file(writer, path, mtime, size, data, (uint32_t)chunks);
+}
+
+// Функция для чтения блока из функции чтения: до CHUNK_SIZE байт или до конца данных
+static int64_t writer_read_chunk(sa_read_fn read, void *context, uint8_t *buffer) {
+    size_t total = 0;
+    while (total < CHUNK_SIZE) {
+        int64_t n = read(context, buffer + total, CHUNK_SIZE - total);
+        if (n < 0 || (uint64_t)n > CHUNK_SIZE - total) return -1;
+        if (n == 0) break; // Конец данных
+        total += (size_t)n;
+    }
+    return (int64_t)total;
+}
+
+// Функция для добавления файла из функции чтения. Размер заранее неизвестен, поэтому запись
+// STREAMED_FILE_ENTRY выводится по мере чтения: каждый блок читается в staging, кодируется в dst
+// и сразу пишется в архив вместе со своим описанием. Память не зависит от размера файла:
+// от блока к блоку сохраняется только его хеш для каталога.
+// Заголовок выводится после первого успешного чтения: если чтение сразу вернуло ошибку,
+// в архив ничего не попадает. Ошибка чтения после этого портит архив, и писатель
+// больше не принимает записей.
+int sa_writer_add_callback(sa_writer_t *writer, const char *path, int64_t mtime, sa_read_fn read, void *context) {
+    if (writer_check(writer, path) != 0) return -1;
+    if ((!writer->dst && !(writer->dst = malloc(CHUNK_SIZE))) || writer_reserve_staging(writer, 0, CHUNK_SIZE) != 0) {
+        perror("malloc");
+        return -1;
+    }
+
+    FILE *archive = writer->archive.file;
+    size_t slot = SIZE_MAX;
+    uint64_t size = 0, stored_size = 0;
+    uint32_t count = 0;
+    int started = 0;
+    while (1) {
+        int64_t n = writer_read_chunk(read, context, writer->staging);
+        if (n < 0) {
+            fprintf(stderr, "Ошибка: не удалось прочитать данные записи %s\n", path);
+            if (started) writer->failed = 1; // Начало записи уже в архиве
+            return -1;
+        }
+        if (!started) {
+            slot = write_entry_header(&writer->archive, STREAMED_FILE_ENTRY, path, mtime);
+            started = 1;
+        }
+        if (n == 0) break;
+        if (count == UINT32_MAX || writer_reserve_chunk(writer, count) != 0) {
+            writer->failed = 1;
+            return -1;
+        }
+
+        chunk_info_t info;
+        writer->hashes[count] = sa_internal_content_hash(writer->staging, (size_t)n, 0);
+        size_t encoded = sa_internal_encode_chunk(writer->staging, (size_t)n, writer->dst, &info, &writer->scratch);
+        write_chunk_info(archive, &info);
+        fwrite(encoded > 0 ? writer->dst : writer->staging, 1, info.stored_size, archive);
+        stored_size += info.stored_size;
+        size += (uint64_t)n;
+        count++;
+        if (n < CHUNK_SIZE) break; // Неполный блок — последний
+    }
+    chunk_info_t end = {0}; // Нулевое описание завершает запись
+    write_chunk_info(archive, &end);
+
+    if (slot != SIZE_MAX) {
+        index_entry_t *entry = &writer->archive.index.entries[slot];
+        entry->original_size = size;
+        entry->stored_size = stored_size;
+        entry->hash = combine_chunk_hashes(writer->hashes, count, size);
+    }
+    return writer_status(writer);
+}
+
+// Функция для завершения архива: дописывает центральный каталог и освобождает писателя
+int sa_writer_finish(sa_writer_t *writer, void **data, size_t *size) {
+    int result = writer->failed ? -1 : 0;
+    write_central_directory(&writer->archive);
+    if (ferror(writer->archive.file)) result = -1;
+    if (fclose(writer->archive.file) != 0) result = -1; // Закрытие выводит остаток буфера
+    if (result != 0) fprintf(stderr, "Ошибка: не удалось записать архив\n");
+
+    if (result == 0 && data) { // Архив в памяти переходит вызывающему
+        *data = writer->memory;
+        if (size) *size = writer->memory_size;
+        writer->memory = NULL;
+    }
+    writer_free(writer);
+    return result;
+}
+
+// Функция для создания читателя архива в памяти: каталог читается через поток stdio поверх памяти
+static sa_reader_t *reader_create(const uint8_t *data, uint64_t size, uint64_t mapped_size) {
+    sa_reader_t *reader = calloc(1, sizeof(sa_reader_t));
+    if (!reader) {
+        perror("calloc");
+        return NULL;
+    }
+    reader->data = data;
+    reader->size = size;
+    reader->mapped_size = mapped_size;
+    reader->block_offset = UINT64_MAX;
+    reader->decoded_block = UINT64_MAX;
+
+    if (size > 0) { // В пустом архиве нет записей
+        FILE *archive = fmemopen((void *)data, (size_t)size, "rb");
+        if (!archive) {
+            perror("fmemopen");
+            free(reader);
+            return NULL;
+        }
+        int result = read_index(archive, &reader->index);
+        fclose(archive);
+        if (result != 0) {
+            free(reader);
+            return NULL;
+        }
+        if (!(reader->locations = calloc(reader->index.count ? reader->index.count : 1, sizeof(reader_location_t)))) {
+            perror("calloc");
+            free_index(&reader->index);
+            free(reader);
+            return NULL;
+        }
+    }
+    sa_internal_rle_init_kernels();
+    return reader;
+}
+
+// Функция для открытия читателя архива в памяти вызывающего
+sa_reader_t *sa_reader_open_memory(const void *data, size_t size) {
+    return reader_create(data, size, 0);
+}
+
+// Функция для открытия читателя файла архива: файл отображается в память целиком
+sa_reader_t *sa_reader_open_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return NULL;
+    }
+    struct stat archive_stat;
+    if (fstat(fd, &archive_stat) != 0) {
+        perror("fstat");
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t size = (uint64_t)archive_stat.st_size;
+    const uint8_t *data = NULL;
+    if (size > 0) {
+        void *map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return NULL;
+        }
+        data = map;
+    }
+    close(fd); // Отображение остается действительным и без дескриптора
+
+    sa_reader_t *reader = reader_create(data, size, size);
+    if (!reader && data) munmap((void *)data, (size_t)size);
+    return reader;
+}
+
+// Функция для разбора заголовка записи по смещению: тип записи и смещение ее данных
+static int reader_entry_payload(const sa_reader_t *reader, uint64_t offset, uint8_t *entry_type, uint64_t *payload) {
+    uint64_t end = reader->index.data_end;
+    uint16_t path_length;
+    if (offset > end || end - offset < 3) return -1;
+    *entry_type = reader->data[offset];
+    memcpy(&path_length, reader->data + offset + 1, sizeof(uint16_t));
+    if (end - offset - 3 < path_length) return -1;
+    *payload = offset + 3 + path_length;
+    return 0;
+}
+
+// Функция для выдачи следующей записи каталога. Строки сплошных блоков не выдаются:
+// по ним отсчитываются смещения файлов блока, которые идут в каталоге следом.
+int sa_reader_next(sa_reader_t *reader, sa_entry_t *entry) {
+    while (reader->next < reader->index.count) {
+        reader_location_t *location = &reader->locations[reader->next];
+        const index_entry_t *row = &reader->index.entries[reader->next];
+        memset(entry, 0, sizeof(*entry));
+        entry->type = SA_ENTRY_FILE;
+        entry->path = row->path;
+        entry->size = row->original_size;
+        entry->mtime = row->mtime;
+        entry->hash = row->hash;
+        entry->cursor = reader->next++;
+        location->offset = row->offset;
+        location->issued = 1;
+
+        switch (row->entry_type) {
+            case DIRECTORY_ENTRY:
+                entry->type = SA_ENTRY_DIRECTORY;
+                return 1;
+            case FILE_ENTRY:
+            case CHUNKED_FILE_ENTRY:
+            case STREAMED_FILE_ENTRY:
+                return 1;
+            case DUPLICATE_ENTRY: { // Копия выдается с данными первой копии
+                uint8_t entry_type;
+                uint64_t payload;
+                if (reader_entry_payload(reader, row->offset, &entry_type, &payload) != 0
+                    || reader->index.data_end - payload < sizeof(uint64_t)) break;
+                memcpy(&location->offset, reader->data + payload, sizeof(uint64_t));
+                if (location->offset >= row->offset) break;
+                return 1;
+            }
+            case SOLID_BLOCK_ENTRY:
+                reader->block_offset = row->offset;
+                reader->member_offset = 0;
+                continue;
+            case SOLID_MEMBER_ENTRY:
+                if (row->offset != reader->block_offset) break;
+                location->member = 1;
+                location->member_offset = reader->member_offset;
+                reader->member_offset += row->original_size;
+                return 1;
+            default:
+                break;
+        }
+        location->issued = 0;
+        fprintf(stderr, "Ошибка: архив поврежден\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Функция для поиска положения данных записи, выданной читателем. NULL — запись выдана не им.
+static const reader_location_t *reader_location(const sa_reader_t *reader, const sa_entry_t *entry) {
+    if (entry->cursor >= reader->index.count || !reader->locations[entry->cursor].issued) {
+        fprintf(stderr, "Ошибка: запись %s выдана не этим читателем\n", entry->path);
+        return NULL;
+    }
+    return &reader->locations[entry->cursor];
+}
+
+// Функция для получения данных файла сплошного блока. Несжатый блок отдается указателем
+// в архив, сжатый декодируется в block один раз для всех его файлов.
+static const uint8_t *reader_member_data(sa_reader_t *reader, const reader_location_t *location, uint64_t size) {
+    uint8_t entry_type;
+    uint64_t p, end = reader->index.data_end;
+    uint32_t count;
+    if (reader_entry_payload(reader, location->offset, &entry_type, &p) != 0 || entry_type != SOLID_BLOCK_ENTRY
+        || end - p < sizeof(uint32_t)) return NULL;
+    memcpy(&count, reader->data + p, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+
+    // Пропускаем таблицу файлов блока: длина пути, путь, размер, время изменения
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t path_length;
+        if (end - p < sizeof(uint16_t)) return NULL;
+        memcpy(&path_length, reader->data + p, sizeof(uint16_t));
+        uint64_t member_size = sizeof(uint16_t) + path_length + sizeof(uint32_t) + sizeof(int64_t);
+        if (end - p < member_size) return NULL;
+        p += member_size;
+    }
+
+    chunk_info_t info;
+    if (end - p < CHUNK_INFO_SIZE) return NULL;
+    load_chunk_info(reader->data + p, &info);
+    p += CHUNK_INFO_SIZE;
+    if (info.original_size > MAX_CHUNK_SIZE || end - p < info.stored_size
+        || location->member_offset > info.original_size || info.original_size - location->member_offset < size) return NULL;
+
+    if (info.codec == CODEC_STORED) {
+        return info.stored_size == info.original_size ? reader->data + p + location->member_offset : NULL;
+    }
+    if (reader->decoded_block != location->offset) {
+        reader->decoded_block = UINT64_MAX;
+        if (ensure_buffer(&reader->block, &reader->block_capacity, info.original_size ? info.original_size : 1) != 0
+            || sa_internal_decode_chunk(&info, reader->data + p, reader->block) != 0) return NULL;
+        reader->decoded_block = location->offset;
+    }
+    return reader->block + location->member_offset;
+}
+
+// Функция для чтения описания очередного блока записи STREAMED_FILE_ENTRY в памяти по смещению *p.
+// Возвращает 1 и сдвигает *p на данные блока, 0 на завершающем нулевом описании и -1, если архив поврежден.
+static int reader_streamed_chunk(const sa_reader_t *reader, uint64_t *p, chunk_info_t *info) {
+    uint64_t end = reader->index.data_end;
+    if (end - *p < CHUNK_INFO_SIZE) return -1;
+    load_chunk_info(reader->data + *p, info);
+    *p += CHUNK_INFO_SIZE;
+    if (info->original_size == 0) return info->stored_size == 0 ? 0 : -1;
+    if (info->original_size > MAX_CHUNK_SIZE || end - *p < info->stored_size) return -1;
+    return 1;
+}
+
+// Функция для сборки данных записи STREAMED_FILE_ENTRY в buffer читателя.
+// Несжатые блоки копируются, остальные декодируются прямо на свое место.
+static const uint8_t *reader_streamed_data(sa_reader_t *reader, uint64_t p, uint64_t size) {
+    chunk_info_t info;
+    uint64_t total = 0;
+    int status;
+    if (ensure_buffer(&reader->buffer, &reader->buffer_capacity, size ? (size_t)size : 1) != 0) return NULL;
+    while ((status = reader_streamed_chunk(reader, &p, &info)) > 0) {
+        if (size - total < info.original_size) return NULL;
+        if (info.codec == CODEC_STORED && info.stored_size == info.original_size) {
+            memcpy(reader->buffer + total, reader->data + p, info.original_size);
+        } else if (sa_internal_decode_chunk(&info, reader->data + p, reader->buffer + total) != 0) {
+            return NULL;
+        }
+        total += info.original_size;
+        p += info.stored_size;
+    }
+    return status == 0 && total == size ? reader->buffer : NULL;
+}
+
+// Функция для получения данных файла целиком
+const void *sa_reader_data(sa_reader_t *reader, const sa_entry_t *entry) {
+    static const uint8_t empty[1]; // Данные пустого файла
+    const uint8_t *result = NULL;
+    uint8_t entry_type;
+    uint64_t payload;
+
+    if (entry->type != SA_ENTRY_FILE || entry->size > SIZE_MAX) {
+        fprintf(stderr, "Ошибка: запись %s не является файлом\n", entry->path);
+        return NULL;
+    }
+    const reader_location_t *location = reader_location(reader, entry);
+    if (!location) return NULL;
+    if (location->member) {
+        result = reader_member_data(reader, location, entry->size);
+    } else if (reader_entry_payload(reader, location->offset, &entry_type, &payload) == 0) {
+        uint64_t available = reader->index.data_end - payload;
+        const uint8_t *p = reader->data + payload;
+        chunked_view_t view;
+        uint64_t original_size, stored_size;
+
+        if (entry_type == CHUNKED_FILE_ENTRY && parse_chunked_payload(p, available, &view) == 0
+            && view.original_size == entry->size) {
+            if (view.all_stored) { // Несжатые блоки идут подряд — это и есть данные файла
+                result = view.data;
+            } else if (ensure_buffer(&reader->buffer, &reader->buffer_capacity, entry->size ? entry->size : 1) == 0
+                       && decode_chunked_payload(&view, reader->buffer) == 0) {
+                result = reader->buffer;
+            }
+        } else if (entry_type == STREAMED_FILE_ENTRY) {
+            result = reader_streamed_data(reader, payload, entry->size);
+        } else if (entry_type == FILE_ENTRY && available >= 2 * sizeof(uint64_t)) { // Файл прежнего формата: пары RLE
+            memcpy(&original_size, p, sizeof(uint64_t));
+            memcpy(&stored_size, p + 8, sizeof(uint64_t));
+            if (original_size == entry->size && stored_size <= available - 2 * sizeof(uint64_t)
+                && ensure_buffer(&reader->buffer, &reader->buffer_capacity, entry->size ? entry->size : 1) == 0
+                && rle_decode_buffer(p + 16, stored_size, reader->buffer, entry->size) == 0) {
+                result = reader->buffer;
+            }
+        }
+    }
+
+    if (!result) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return NULL;
+    }
+    return entry->size ? result : empty;
+}
+
+// Функция для вывода одного блока функцией write: несжатый блок передается прямо из архива,
+// остальные декодируются в buffer читателя
+static int reader_write_chunk(sa_reader_t *reader, const chunk_info_t *info, const uint8_t *src, sa_write_fn write, void *context) {
+    const uint8_t *data = src;
+    if (info->codec != CODEC_STORED) {
+        if (ensure_buffer(&reader->buffer, &reader->buffer_capacity, info->original_size ? info->original_size : 1) != 0) return -1;
+        if (sa_internal_decode_chunk(info, src, reader->buffer) != 0) {
+            fprintf(stderr, "Ошибка: архив поврежден\n");
+            return -1;
+        }
+        data = reader->buffer;
+    } else if (info->stored_size != info->original_size) {
+        fprintf(stderr, "Ошибка: архив поврежден\n");
+        return -1;
+    }
+    return info->original_size ? write(context, data, info->original_size) : 0;
+}
+
+// Функция для вывода данных файла функцией write по блокам
+int sa_reader_stream(sa_reader_t *reader, const sa_entry_t *entry, sa_write_fn write, void *context) {
+    if (entry->type == SA_ENTRY_DIRECTORY) return 0; // У директории нет данных
+
+    uint8_t entry_type;
+    uint64_t payload;
+    chunked_view_t view;
+    const reader_location_t *location = reader_location(reader, entry);
+    if (!location) return -1;
+    if (location->member || reader_entry_payload(reader, location->offset, &entry_type, &payload) != 0
+        || (entry_type != CHUNKED_FILE_ENTRY && entry_type != STREAMED_FILE_ENTRY)) { // Сплошной блок и прежний формат декодируются целиком
+        const void *data = sa_reader_data(reader, entry);
+        if (!data) return -1;
+        return entry->size ? write(context, data, (size_t)entry->size) : 0;
+    }
+
+    if (entry_type == STREAMED_FILE_ENTRY) { // Описание каждого блока идет перед его данными
+        chunk_info_t info;
+        uint64_t total = 0;
+        int status;
+        while ((status = reader_streamed_chunk(reader, &payload, &info)) > 0) {
+            if (entry->size - total < info.original_size) {
+                status = -1;
+                break;
+            }
+            if (reader_write_chunk(reader, &info, reader->data + payload, write, context) != 0) return -1;
+            total += info.original_size;
+            payload += info.stored_size;
+        }
+        if (status != 0 || total != entry->size) {
+            fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (parse_chunked_payload(reader->data + payload, reader->index.data_end - payload, &view) != 0
+        || view.original_size != entry->size) {
+        fprintf(stderr, "Ошибка: архив поврежден или обрезан\n");
+        return -1;
+    }
+
+    const uint8_t *src = view.data;
+    for (uint32_t i = 0; i < view.chunk_count; i++) {
+        chunk_info_t info;
+        load_chunk_info(view.table + (size_t)i * CHUNK_INFO_SIZE, &info);
+        if (reader_write_chunk(reader, &info, src, write, context) != 0) return -1;
+        src += info.stored_size;
+    }
+    return 0;
+}
+
+// Функция для закрытия читателя
+void sa_reader_close(sa_reader_t *reader) {
+    if (!reader) return;
+    free_index(&reader->index);
+    free(reader->locations);
+    free(reader->block);
+    free(reader->buffer);
+    if (reader->mapped_size) munmap((void *)reader->data, (size_t)reader->mapped_size);
+    free(reader);
+}
@@ -0,0 +1,130 @@
+// Библиотека simplearchiver: архивы .sa в памяти и на диске.
+//
+// Три уровня API:
+//   - буферные кодеки: кодирование и декодирование буфера в буфер без выделения памяти,
+//     рабочая память кодировщика передается вызывающим;
+//   - потоковый писатель: записи из буферов или функций чтения, архив — в память или в функцию записи;
+//   - читатель: обход записей архива в памяти или отображенного файла, данные без копирования;
+// и операции над файлами и директориями, которые выполняет программа archiver.
+//
+// Функции возвращают 0 при успехе и -1 при ошибке (описание ошибки выводится в stderr),
+// если не сказано иное.
+
+#ifndef SIMPLEARCHIVER_H
+#define SIMPLEARCHIVER_H
+
+#include <stddef.h>      // Библиотека для size_t
+#include <stdint.h>      // Библиотека для определения целочисленных типов с фиксированной шириной
+#include <stdio.h>       // Библиотека для FILE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__) && defined(SA_BUILD_LIBRARY)
+#define SA_API __attribute__((visibility("default"))) // Функция экспортируется из разделяемой библиотеки
+#else
+#define SA_API
+#endif
+
+#define SA_CHUNK_SIZE (4 << 20)      // Размер блока, на которые делятся данные файла (4 МБ)
+#define SA_CODEC_SCRATCH_SIZE 69632  // Размер рабочей памяти кодировщика для sa_encode
+#define SA_ENTRY_FILE 1              // Запись читателя: файл
+#define SA_ENTRY_DIRECTORY 2         // Запись читателя: директория
+#define SA_MIN_BUFFER_SIZE 4096      // Наименьший размер буферов ввода-вывода (sa_options_t.buffer_size)
+#define SA_MAX_THREADS 1024          // Наибольшее число рабочих потоков (sa_options_t.threads)
+
+// Параметры операций над файлами и директориями
+typedef struct {
+    size_t buffer_size;      // Размер буферов ввода-вывода (опция -b)
+    int threads;             // Число рабочих потоков (опция -j, 0 — по числу процессоров)
+    int inode_order;         // Читать файлы директории в порядке inode (опция -inode)
+    int content_hashing;     // Хешировать содержимое файлов (опция -hash)
+    int deduplicate;         // Хранить одинаковые файлы один раз (отключается опцией -nodedup)
+    int hardlink_duplicates; // Восстанавливать копии жесткими ссылками (опция -hardlink)
+    int solid_blocks;        // Собирать мелкие файлы в сплошные блоки (опция -solid)
+} sa_options_t;
+
+// Функция записи: выводит size байт из data; возвращает 0 или -1 при ошибке
+typedef int (*sa_write_fn)(void *context, const void *data, size_t size);
+
+// Функция чтения: заполняет buffer не более чем size байтами;
+// возвращает число прочитанных байтов, 0 в конце данных и -1 при ошибке
+typedef int64_t (*sa_read_fn)(void *context, void *buffer, size_t size);
+
+typedef struct sa_writer sa_writer_t; // Архив, открытый на запись
+typedef struct sa_reader sa_reader_t; // Архив, открытый на чтение
+
+// Запись архива, которую выдает читатель. Строка path и данные записи принадлежат читателю.
+typedef struct {
+    int type;                // SA_ENTRY_FILE или SA_ENTRY_DIRECTORY
+    const char *path;        // Относительный путь (действителен до sa_reader_close)
+    uint64_t size;           // Размер файла
+    int64_t mtime;           // Время изменения (секунды Unix, 0 — неизвестно)
+    uint64_t hash;           // Хеш содержимого (0 — не вычислялся)
+    uint64_t cursor;         // Служебное: положение записи у выдавшего ее читателя, не изменять
+} sa_entry_t;
+
+// Параметры по умолчанию: как у программы archiver без опций
+SA_API void sa_options_init(sa_options_t *options);
+// Разбор размера вида 65536, 512K, 4M или 1G не меньше min (как параметр -b архиватора).
+// Возвращает -1 без сообщения, если строка не является таким размером.
+SA_API int sa_parse_size(const char *text, size_t min, size_t *size);
+
+// Операции программы archiver; options может быть NULL (параметры по умолчанию)
+SA_API int sa_pack(const char *input_path, const char *archive_path, const sa_options_t *options);
+SA_API int sa_update(const char *previous_path, const char *input_path, const char *archive_path, const sa_options_t *options);
+SA_API int sa_unpack(const char *archive_path, const char *output_folder, const sa_options_t *options);
+SA_API int sa_extract(const char *archive_path, const char *entry_path, const char *output_folder, const sa_options_t *options);
+SA_API int sa_list(const char *archive_path, FILE *out);
+
+// Буферные кодеки. Закодированный буфер самодостаточен: в нем записаны исходный размер,
+// таблица блоков и блоки — в том же виде, что и данные файла в архиве.
+SA_API size_t sa_encode_bound(size_t size);
+// Кодирует size байт из src в dst емкостью capacity. scratch — SA_CODEC_SCRATCH_SIZE байт,
+// выровненных как память malloc. Возвращает размер результата или 0, если он не помещается.
+SA_API size_t sa_encode(const void *src, size_t size, void *dst, size_t capacity, void *scratch);
+// Читает исходный размер закодированного буфера
+SA_API int sa_decoded_size(const void *src, size_t size, uint64_t *decoded_size);
+// Декодирует буфер в dst емкостью capacity (не меньше исходного размера)
+SA_API int sa_decode(const void *src, size_t size, void *dst, size_t capacity);
+// 64-битный хеш данных, тот же, что хранится в каталоге архива для файла с этими данными
+// (0 — не удалось выделить память для данных больше 1 ГБ)
+SA_API uint64_t sa_hash(const void *data, size_t size);
+
+// Писатель. Архив собирается в памяти (sa_writer_finish возвращает его, освобождать free())
+// или выводится функцией write по мере записи.
+// Память писателя: sa_writer_add_buffer кодирует запись целиком и держит ее сжатые блоки
+// (не больше size байт) до вывода; sa_writer_add_callback выводит каждый блок SA_CHUNK_SIZE
+// сразу после чтения и держит два буфера по SA_CHUNK_SIZE плюс несколько десятков байт
+// на блок. Записи из sa_writer_add_callback читаются этой версией библиотеки и новее.
+// Если read вернула ошибку при первом вызове, запись пропускается; ошибка после успешного
+// чтения оставляет архив неполным: писатель перестает принимать записи, sa_writer_finish возвращает -1.
+SA_API sa_writer_t *sa_writer_open_memory(void);
+SA_API sa_writer_t *sa_writer_open_callback(sa_write_fn write, void *context);
+SA_API int sa_writer_add_directory(sa_writer_t *writer, const char *path, int64_t mtime);
+SA_API int sa_writer_add_buffer(sa_writer_t *writer, const char *path, int64_t mtime, const void *data, size_t size);
+SA_API int sa_writer_add_callback(sa_writer_t *writer, const char *path, int64_t mtime, sa_read_fn read, void *context);
+// Дописывает каталог и освобождает писателя. Для архива в памяти data и size получают
+// результат; при ошибке писатель все равно освобождается.
+SA_API int sa_writer_finish(sa_writer_t *writer, void **data, size_t *size);
+
+// Читатель. Архив в памяти не копируется и должен жить до sa_reader_close.
+SA_API sa_reader_t *sa_reader_open_memory(const void *data, size_t size);
+SA_API sa_reader_t *sa_reader_open_file(const char *path);
+// Выдает следующую запись: 1 — запись в entry, 0 — записи кончились, -1 — архив поврежден.
+// Сплошные блоки выдаются по файлам, копии файлов — как обычные файлы с данными первой копии.
+SA_API int sa_reader_next(sa_reader_t *reader, sa_entry_t *entry);
+// Данные файла целиком. Несжатые данные выдаются указателем прямо в архив, сжатые
+// декодируются в буфер читателя. Указатель действителен до следующего вызова для этого читателя.
+SA_API const void *sa_reader_data(sa_reader_t *reader, const sa_entry_t *entry);
+// Данные файла по блокам: память читателя ограничена размером блока, несжатые блоки
+// передаются в write прямо из архива
+SA_API int sa_reader_stream(sa_reader_t *reader, const sa_entry_t *entry, sa_write_fn write, void *context);
+SA_API void sa_reader_close(sa_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIMPLEARCHIVER_H
@@ -0,0 +1,64 @@
+// Внутренний интерфейс библиотеки simplearchiver: кодеки блоков и вспомогательный ввод-вывод.
+//
+// Заголовок не устанавливается вместе с simplearchiver.h и не входит в открытый API:
+// его подключают только сама библиотека и программа измерения производительности,
+// которая вызывает кодеки напрямую из libsimplearchiver. Функции отсюда не экспортируются
+// из разделяемой библиотеки, а форматы и сигнатуры могут меняться без предупреждения.
+// Статическая библиотека видит их все, поэтому имена начинаются с sa_internal_ и не
+// пересекаются с функциями программы, которая ее подключает.
+
+#ifndef SIMPLEARCHIVER_INTERNAL_H
+#define SIMPLEARCHIVER_INTERNAL_H
+
+#include <stddef.h>      // Библиотека для size_t
+#include <stdint.h>      // Библиотека для определения целочисленных типов с фиксированной шириной
+#include <sys/types.h>   // Библиотека для off_t
+
+#include "simplearchiver.h" // Открытый интерфейс библиотеки (SA_CHUNK_SIZE)
+
+#if defined(__GNUC__)
+#define SA_INTERNAL __attribute__((visibility("hidden"))) // Функция видна только внутри библиотеки
+#else
+#define SA_INTERNAL
+#endif
+
+#define CODEC_STORED 0x00       // Идентификатор кодека блока: данные без сжатия
+#define CODEC_RLE 0x01          // Идентификатор кодека блока: RLE-пары (счетчик, байт), только чтение
+#define CODEC_PACKBITS 0x02     // Идентификатор кодека блока: RLE с управляющим байтом (PackBits)
+#define CODEC_LZ 0x03           // Идентификатор кодека блока: быстрый LZ77
+#define LZ_HASH_BITS 14         // Размер хеш-таблицы LZ-кодировщика (2^14 позиций)
+#define CODEC_SAMPLE_SIZE 4096  // Размер одного образца при выборе кодека
+#define CHUNK_SIZE SA_CHUNK_SIZE // Размер блока файла при упаковке (4 МБ)
+#define RLE_MAX_RUN 255         // Максимальная длина серии в одной паре (счетчик, байт)
+
+// Ядро поиска серии: число первых байтов p[0..n), равных value
+typedef size_t (*rle_match_fn)(const uint8_t *p, size_t n, uint8_t value);
+
+// Описание одного блока в таблице блоков записи CHUNKED_FILE_ENTRY
+typedef struct {
+    uint32_t original_size; // Размер исходных данных блока
+    uint32_t stored_size;   // Размер закодированных данных блока в архиве
+    uint8_t codec;          // Кодек, которым закодирован блок
+    uint64_t hash;          // Хеш исходных данных блока (только в памяти, в таблицу не пишется)
+} chunk_info_t;
+
+// Рабочая память кодировщика блока: хеш-таблица LZ и результат пробного кодирования образцов.
+// Ее выделяет вызывающий, поэтому кодирование не выделяет память и не занимает стек потока.
+typedef struct {
+    uint32_t lz_table[1 << LZ_HASH_BITS]; // Последняя позиция + 1 для каждого хеша (0 — пусто)
+    uint8_t sample[CODEC_SAMPLE_SIZE];    // Результат пробного кодирования образца
+} codec_scratch_t;
+
+SA_INTERNAL extern rle_match_fn sa_internal_rle_match_run; // Выбранное ядро поиска серии (после sa_internal_rle_init_kernels)
+
+SA_INTERNAL void sa_internal_rle_init_kernels(void);     // Выбор векторных ядер RLE под текущий процессор
+SA_INTERNAL size_t sa_internal_packbits_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap); // Кодирование PackBits
+SA_INTERNAL size_t sa_internal_lz_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint32_t *table); // Кодирование LZ77
+SA_INTERNAL size_t sa_internal_encode_chunk(const uint8_t *src, size_t n, uint8_t *dst, chunk_info_t *info, codec_scratch_t *scratch); // Кодирование блока файла
+SA_INTERNAL int sa_internal_decode_chunk(const chunk_info_t *info, const uint8_t *src, uint8_t *dst); // Декодирование блока файла
+SA_INTERNAL uint64_t sa_internal_content_hash(const uint8_t *data, size_t n, uint64_t seed); // 64-битный хеш данных
+SA_INTERNAL int sa_internal_create_directory(const char *path);  // Создание директории, если она не существует
+SA_INTERNAL size_t sa_internal_read_chunk(int fd, uint8_t *buf, size_t len, off_t offset); // Чтение len байтов по смещению
+SA_INTERNAL int sa_internal_write_at(int fd, const uint8_t *buf, size_t len, uint64_t offset); // Запись len байтов по смещению
+
+#endif // SIMPLEARCHIVER_INTERNAL_H
@@ -0,0 +1,288 @@
+// Проверка открытого API libsimplearchiver: буферные кодеки, писатель и читатель.
+//
+// Программа собирается со статической библиотекой и запускается из make check.
+// Каждая проверка выводит строку ok/FAIL; код возврата 1, если хотя бы одна не прошла.
+
+#include <stdio.h>       // Библиотека для работы с вводом-выводом
+#include <stdlib.h>      // Библиотека для работы с памятью и процессами
+#include <string.h>      // Библиотека для работы со строками
+#include <stdint.h>      // Библиотека для определения целочисленных типов с фиксированной шириной
+#include <unistd.h>      // Библиотека для rmdir и unlink
+
+#include "../src/simplearchiver.h" // Открытый интерфейс библиотеки
+
+static int failures = 0; // Число непрошедших проверок
+
+// Функция для вывода результата одной проверки
+static void check(int passed, const char *name) {
+    printf("%s  %s\n", passed ? "ok  " : "FAIL", name);
+    if (!passed) failures++;
+}
+
+// Функция для заполнения буфера данными: серии одинаковых байтов вперемешку с псевдослучайными,
+// чтобы в одном буфере встречались и сжимаемые, и несжимаемые блоки
+static void fill_data(uint8_t *data, size_t size, uint32_t seed) {
+    uint32_t state = seed | 1;
+    for (size_t i = 0; i < size; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[i] = (i / 65536) % 2 ? (uint8_t)state : (uint8_t)(i / 512);
+    }
+}
+
+// Функция для проверки кодирования и декодирования буфера размера size
+static void check_codec(size_t size, const char *name) {
+    uint8_t *src = malloc(size ? size : 1);
+    size_t bound = sa_encode_bound(size);
+    uint8_t *encoded = malloc(bound);
+    uint8_t *decoded = malloc(size ? size : 1);
+    void *scratch = malloc(SA_CODEC_SCRATCH_SIZE);
+    if (!src || !encoded || !decoded || !scratch) {
+        check(0, name);
+    } else {
+        fill_data(src, size, (uint32_t)size);
+        size_t encoded_size = sa_encode(src, size, encoded, bound, scratch);
+        uint64_t decoded_size = UINT64_MAX;
+        check(encoded_size > 0 && encoded_size <= bound
+              && sa_decoded_size(encoded, encoded_size, &decoded_size) == 0 && decoded_size == size
+              && sa_decode(encoded, encoded_size, decoded, size) == 0
+              && memcmp(src, decoded, size) == 0, name);
+    }
+    free(src);
+    free(encoded);
+    free(decoded);
+    free(scratch);
+}
+
+// Источник данных для sa_writer_add_callback: выдает буфер кусками не больше step байт
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+    size_t step;
+} read_source_t;
+
+// Функция чтения для sa_writer_add_callback
+static int64_t read_source(void *context, void *buffer, size_t size) {
+    read_source_t *source = context;
+    size_t n = source->size - source->position;
+    if (n > size) n = size;
+    if (n > source->step) n = source->step;
+    memcpy(buffer, source->data + source->position, n);
+    source->position += n;
+    return (int64_t)n;
+}
+
+// Приемник данных для sa_writer_open_callback и sa_reader_stream: накапливает их в памяти
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} sink_t;
+
+// Функция записи в приемник
+static int write_sink(void *context, const void *data, size_t size) {
+    sink_t *sink = context;
+    if (sink->capacity - sink->size < size) {
+        size_t capacity = sink->capacity ? sink->capacity : 4096;
+        while (capacity - sink->size < size) capacity *= 2;
+        uint8_t *grown = realloc(sink->data, capacity);
+        if (!grown) return -1;
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+    memcpy(sink->data + sink->size, data, size);
+    sink->size += size;
+    return 0;
+}
+
+// Функция записи в файл для sa_writer_open_callback
+static int write_file(void *context, const void *data, size_t size) {
+    return fwrite(data, 1, size, context) == size ? 0 : -1;
+}
+
+// Файлы проверочного архива: путь и данные
+typedef struct {
+    const char *path;
+    const uint8_t *data;
+    size_t size;
+    int from_callback; // Записывается через sa_writer_add_callback
+} test_file_t;
+
+// Функция для записи проверочного архива писателем: директория и файлы из files
+static int write_archive(sa_writer_t *writer, const test_file_t *files, size_t count) {
+    if (!writer || sa_writer_add_directory(writer, "tree", 1700000000) != 0) return -1;
+    for (size_t i = 0; i < count; i++) {
+        read_source_t source = { files[i].data, files[i].size, 0, 1000003 };
+        int result = files[i].from_callback
+                     ? sa_writer_add_callback(writer, files[i].path, 1700000000, read_source, &source)
+                     : sa_writer_add_buffer(writer, files[i].path, 1700000000, files[i].data, files[i].size);
+        if (result != 0) return -1;
+    }
+    return 0;
+}
+
+// Функция для проверки, что читатель выдает директорию и все файлы с верными данными
+// через sa_reader_data и sa_reader_stream
+static int read_archive(sa_reader_t *reader, const test_file_t *files, size_t count) {
+    sa_entry_t entry;
+    if (!reader || sa_reader_next(reader, &entry) != 1 || entry.type != SA_ENTRY_DIRECTORY
+        || strcmp(entry.path, "tree") != 0) return -1;
+    for (size_t i = 0; i < count; i++) {
+        if (sa_reader_next(reader, &entry) != 1 || entry.type != SA_ENTRY_FILE
+            || strcmp(entry.path, files[i].path) != 0 || entry.size != files[i].size
+            || entry.mtime != 1700000000) return -1;
+        if (entry.hash != 0 && entry.hash != sa_hash(files[i].data, files[i].size)) return -1;
+
+        const uint8_t *data = sa_reader_data(reader, &entry);
+        if (!data || memcmp(data, files[i].data, files[i].size) != 0) return -1;
+
+        sink_t sink = { NULL, 0, 0 };
+        int streamed = sa_reader_stream(reader, &entry, write_sink, &sink) == 0 && sink.size == files[i].size
+                       && (files[i].size == 0 || memcmp(sink.data, files[i].data, files[i].size) == 0);
+        free(sink.data);
+        if (!streamed) return -1;
+    }
+    return sa_reader_next(reader, &entry) == 0 ? 0 : -1;
+}
+
+// Функция для чтения файла целиком и сравнения с ожидаемыми данными
+static int file_equals(const char *path, const uint8_t *data, size_t size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    uint8_t *buffer = malloc(size + 1);
+    size_t n = buffer ? fread(buffer, 1, size + 1, file) : 0;
+    int equal = buffer && n == size && memcmp(buffer, data, size) == 0;
+    free(buffer);
+    fclose(file);
+    return equal;
+}
+
+// Основная функция проверки
+int main(void) {
+    // Кодеки на границах блока
+    check_codec(0, "sa_encode/sa_decode: 0 bytes");
+    check_codec(1, "sa_encode/sa_decode: 1 byte");
+    check_codec(SA_CHUNK_SIZE - 1, "sa_encode/sa_decode: SA_CHUNK_SIZE - 1 bytes");
+    check_codec(SA_CHUNK_SIZE, "sa_encode/sa_decode: SA_CHUNK_SIZE bytes");
+    check_codec(SA_CHUNK_SIZE + 1, "sa_encode/sa_decode: SA_CHUNK_SIZE + 1 bytes");
+
+    // Закодированный буфер не помещается: sa_encode возвращает 0, sa_decode отвергает малый буфер
+    {
+        uint8_t src[4096], dst[4096 + 64]; // Не меньше sa_encode_bound(4096)
+        void *scratch = malloc(SA_CODEC_SCRATCH_SIZE);
+        fill_data(src, sizeof(src), 7);
+        size_t encoded_size = scratch && sa_encode_bound(sizeof(src)) <= sizeof(dst)
+                              ? sa_encode(src, sizeof(src), dst, sizeof(dst), scratch) : 0;
+        check(scratch && sa_encode(src, sizeof(src), dst, 8, scratch) == 0
+              && encoded_size > 0 && sa_decode(dst, encoded_size, src, sizeof(src) - 1) == -1
+              && sa_decode(dst, 4, src, sizeof(src)) == -1, "sa_encode/sa_decode: short buffers rejected");
+        free(scratch);
+    }
+
+    // Данные файлов архива: крупный файл из нескольких блоков, пустой и однобайтовый
+    size_t large_size = 2 * (size_t)SA_CHUNK_SIZE + 12345;
+    uint8_t *large = malloc(large_size);
+    if (!large) {
+        perror("malloc");
+        return 1;
+    }
+    fill_data(large, large_size, 42);
+    static const uint8_t one[1] = { 'x' };
+    const test_file_t files[] = {
+        { "tree/buffer.bin", large, large_size, 0 },
+        { "tree/empty.bin", one, 0, 0 },
+        { "tree/one.bin", one, 1, 0 },
+        { "tree/callback.bin", large, large_size, 1 },
+        { "tree/callback_chunk.bin", large, SA_CHUNK_SIZE, 1 },
+        { "tree/callback_empty.bin", one, 0, 1 },
+    };
+    size_t file_count = sizeof(files) / sizeof(files[0]);
+
+    // Архив в памяти: писатель и читатель
+    void *archive = NULL;
+    size_t archive_size = 0;
+    sa_writer_t *writer = sa_writer_open_memory();
+    int written = write_archive(writer, files, file_count) == 0;
+    written = sa_writer_finish(writer, &archive, &archive_size) == 0 && written;
+    check(written && archive && archive_size > 0, "sa_writer_open_memory: archive written");
+
+    sa_reader_t *reader = written ? sa_reader_open_memory(archive, archive_size) : NULL;
+    check(read_archive(reader, files, file_count) == 0, "sa_reader: buffer and callback entries round-trip");
+
+    // Запись, выданная другим читателем или с испорченным cursor, не принимается
+    {
+        sa_reader_t *first = written ? sa_reader_open_memory(archive, archive_size) : NULL;
+        sa_reader_t *other = written ? sa_reader_open_memory(archive, archive_size) : NULL;
+        sa_entry_t entry, forged;
+        sink_t sink = { NULL, 0, 0 };
+        int rejected = first && other && sa_reader_next(first, &entry) == 1 && sa_reader_next(first, &entry) == 1
+                       && sa_reader_data(other, &entry) == NULL
+                       && sa_reader_stream(other, &entry, write_sink, &sink) == -1;
+        if (rejected) {
+            forged = entry;
+            forged.cursor = UINT64_MAX;
+            rejected = sa_reader_data(first, &forged) == NULL
+                       && sa_reader_stream(first, &forged, write_sink, &sink) == -1
+                       && sa_reader_data(first, &entry) != NULL; // Своя запись по-прежнему читается
+        }
+        free(sink.data);
+        sa_reader_close(first);
+        sa_reader_close(other);
+        check(rejected, "sa_reader: foreign cursor rejected");
+    }
+    sa_reader_close(reader);
+    free(archive);
+
+    // Архив через функцию записи: его читают sa_reader_open_file и sa_unpack
+    char directory[] = "/tmp/sa-api-test.XXXXXX";
+    char archive_path[sizeof(directory) + 16], output_path[sizeof(directory) + 16];
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        free(large);
+        return 1;
+    }
+    snprintf(archive_path, sizeof(archive_path), "%s/test.sa", directory);
+    snprintf(output_path, sizeof(output_path), "%s/out", directory);
+
+    FILE *file = fopen(archive_path, "wb");
+    writer = file ? sa_writer_open_callback(write_file, file) : NULL;
+    written = write_archive(writer, files, file_count) == 0;
+    written = sa_writer_finish(writer, NULL, NULL) == 0 && written;
+    written = file && fclose(file) == 0 && written;
+    check(written, "sa_writer_open_callback: archive written");
+
+    reader = written ? sa_reader_open_file(archive_path) : NULL;
+    check(read_archive(reader, files, file_count) == 0, "sa_reader_open_file: callback archive readable");
+    sa_reader_close(reader);
+
+    int unpacked = written && sa_unpack(archive_path, output_path, NULL) == 0;
+    for (size_t i = 0; unpacked && i < file_count; i++) {
+        char path[sizeof(output_path) + 64];
+        snprintf(path, sizeof(path), "%s/%s", output_path, files[i].path);
+        unpacked = file_equals(path, files[i].data, files[i].size);
+    }
+    check(unpacked, "sa_unpack: callback archive unpacked");
+
+    // Удаляем временные файлы
+    char tree_path[sizeof(output_path) + 8];
+    snprintf(tree_path, sizeof(tree_path), "%s/tree", output_path);
+    for (size_t i = 0; i < file_count; i++) {
+        char path[sizeof(output_path) + 64];
+        snprintf(path, sizeof(path), "%s/%s", output_path, files[i].path);
+        unlink(path);
+    }
+    rmdir(tree_path);
+    rmdir(output_path);
+    unlink(archive_path);
+    rmdir(directory);
+    free(large);
+
+    if (failures) {
+        printf("Проверка API не пройдена: %d\n", failures);
+        return 1;
+    }
+    printf("Все проверки API пройдены\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+#!/bin/sh
+# Проверка архиватора: чтение архива старого формата и упаковка/распаковка с разными параметрами.
+#
+# Использование: tests/check.sh [путь_к_archiver]
+# Запускается из make check. Каждая проверка сравнивает результат с исходным деревом через diff -r.
+
+ARCHIVER=${1:-./archiver}
+DATA=$(cd "$(dirname "$0")/data" && pwd)   # Проверочные данные, записанные в репозиторий
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/sa-check.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# Функция для вывода результата одной проверки
+report() {
+    if [ "$1" -eq 0 ]; then
+        echo "ok    $2"
+    else
+        echo "FAIL  $2"
+        FAILED=1
+    fi
+}
+
+# Функция для распаковки архива и сравнения с исходным деревом: <имя> <архив> <дерево> [параметры]
+unpack_and_compare() {
+    name=$1 archive=$2 tree=$3
+    shift 3
+    rm -rf "$WORK/out"
+    "$ARCHIVER" -unpack "$archive" "$WORK/out" "$@" >/dev/null \
+        && diff -r "$tree" "$WORK/out/$(basename "$tree")" >/dev/null
+    report $? "$name"
+}
+
+# Функция для упаковки дерева и сравнения результата распаковки: <имя> <дерево> [параметры]
+round_trip() {
+    name=$1 tree=$2
+    shift 2
+    rm -f "$WORK/round.sa"
+    if "$ARCHIVER" -pack "$tree" "$WORK/round.sa" "$@" >/dev/null; then
+        unpack_and_compare "$name" "$WORK/round.sa" "$tree" "$@"
+    else
+        report 1 "$name"
+    fi
+}
+
+# Архив старого формата, записанный первой версией архиватора: без каталога и без блоков
+unpack_and_compare "legacy: -unpack" "$DATA/legacy.sa" "$DATA/legacy"
+"$ARCHIVER" -list "$DATA/legacy.sa" | grep -q "legacy/docs/notes/note.txt"
+report $? "legacy: -list"
+rm -rf "$WORK/out" && mkdir "$WORK/out"
+"$ARCHIVER" -extract "$DATA/legacy.sa" legacy/docs "$WORK/out" >/dev/null \
+    && "$ARCHIVER" -extract "$DATA/legacy.sa" legacy/runs.bin "$WORK/out" >/dev/null \
+    && diff -r "$DATA/legacy/docs" "$WORK/out/legacy/docs" >/dev/null \
+    && cmp -s "$DATA/legacy/runs.bin" "$WORK/out/legacy/runs.bin" \
+    && [ ! -e "$WORK/out/legacy/readme.txt" ]
+report $? "legacy: -extract"
+
+# Дерево для упаковки: крупный файл из нескольких блоков, мелкие файлы, копии и пустые элементы
+TREE="$WORK/tree"
+mkdir -p "$TREE/small/deep" "$TREE/empty_dir" "$TREE/copies"
+awk 'BEGIN { for (i = 0; i < 300000; i++) printf "line %d %s\n", i, (i % 13 ? "text" : "aaaaaaaaaaaaaaaa") }' > "$TREE/large.txt"
+head -c 1048576 /dev/urandom > "$TREE/random.bin"
+i=0
+while [ $i -lt 40 ]; do
+    echo "small file $i" > "$TREE/small/file$i.txt"
+    [ $((i % 5)) -eq 0 ] && echo "deep file $i" > "$TREE/small/deep/file$i.txt"
+    i=$((i + 1))
+done
+: > "$TREE/empty.txt"
+cp "$TREE/random.bin" "$TREE/copies/random_copy.bin"
+cp "$TREE/small/file1.txt" "$TREE/copies/file1_copy.txt"
+
+round_trip "pack: -j 1" "$TREE" -j 1
+round_trip "pack: -j 4" "$TREE" -j 4
+round_trip "pack: -solid" "$TREE" -solid
+round_trip "pack: -nodedup" "$TREE" -nodedup
+round_trip "pack: -solid -nodedup -j 1" "$TREE" -solid -nodedup -j 1
+
+# Одинаковые файлы восстанавливаются жесткими ссылками
+round_trip "unpack: -hardlink" "$TREE" -hardlink
+inode_original=$(ls -i "$WORK/out/tree/random.bin" | awk '{ print $1 }')
+inode_copy=$(ls -i "$WORK/out/tree/copies/random_copy.bin" | awk '{ print $1 }')
+[ -n "$inode_original" ] && [ "$inode_original" = "$inode_copy" ]
+report $? "unpack: -hardlink links copies"
+
+# Обновление: часть файлов изменена, часть добавлена, остальное переносится из старого архива
+for solid in "" -solid; do
+    rm -f "$WORK/old.sa" "$WORK/new.sa"
+    UPDATED="$WORK/updated"
+    cp -R "$TREE" "$UPDATED"
+    "$ARCHIVER" -pack "$UPDATED" "$WORK/old.sa" $solid >/dev/null
+    echo "changed" >> "$UPDATED/small/file3.txt"
+    echo "added" > "$UPDATED/small/deep/added.txt"
+    rm "$UPDATED/small/file7.txt"
+    if "$ARCHIVER" -update "$WORK/old.sa" "$UPDATED" "$WORK/new.sa" $solid >/dev/null; then
+        unpack_and_compare "update: -update $solid" "$WORK/new.sa" "$UPDATED"
+    else
+        report 1 "update: -update $solid"
+    fi
+    rm -rf "$UPDATED"
+done
+
+if [ $FAILED -ne 0 ]; then
+    echo "Проверка не пройдена"
+    exit 1
+fi
+echo "Все проверки пройдены"